@@ -0,0 +1,37 @@
+/*
+ * Default spin profile for the H3LIS331DL emulator - spin up, hold, spin down,
+ * stand still, over and over
+ */
+
+#include <zephyr/init.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+
+#include "h3lis331dl_emul.h"
+
+static const struct h3lis331dl_emul_segment spin_segments[] = {
+	{ .duration_ms = 2000, .rpm_start = 0, .rpm_end = 0 },
+	{ .duration_ms = 3000, .rpm_start = 0, .rpm_end = 2000 },
+	{ .duration_ms = 5000, .rpm_start = 2000, .rpm_end = 2000 },
+	{ .duration_ms = 2000, .rpm_start = 2000, .rpm_end = 0 },
+};
+
+static const struct h3lis331dl_emul_profile spin_profile = {
+	.segments = spin_segments,
+	.segment_count = ARRAY_SIZE(spin_segments),
+	.radius_m = 0.03f,
+	.tilt_deg = 5.0f,
+	.repeat = true,
+};
+
+static int accel_emul_profile_init(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+
+	const struct emul *accel_emul = emul_get_binding(DT_LABEL(DT_NODELABEL(accel)));
+	if (!accel_emul) return -ENODEV;
+
+	return h3lis331dl_emul_set_profile(accel_emul, &spin_profile);
+}
+
+SYS_INIT(accel_emul_profile_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
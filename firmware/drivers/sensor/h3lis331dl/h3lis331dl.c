@@ -0,0 +1,336 @@
+/*
+ * ST H3LIS331DL accelerometer - Zephyr sensor driver on top of the ST register driver
+ */
+
+#define DT_DRV_COMPAT st_h3lis331dl
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+#include "h3lis331dl.h"
+#include "h3lis331dl_reg.h"
+#include "h3lis331dl_bus.h"
+
+LOG_MODULE_REGISTER(h3lis331dl, CONFIG_SENSOR_LOG_LEVEL);
+
+#define BOOT_TIME_MS			5
+
+struct h3lis331dl_range {
+	h3lis331dl_fs_t full_scale;
+	uint16_t range_g;
+	uint32_t ug_per_digit;		//12 bit (right justified) sensitivity
+};
+
+static const struct h3lis331dl_range ranges[] = {
+	{ H3LIS331DL_100g, 100, 49000 },
+	{ H3LIS331DL_200g, 200, 98000 },
+	{ H3LIS331DL_400g, 400, 195000 },
+};
+
+static const struct {
+	uint16_t hz;
+	h3lis331dl_dr_t setting;
+} rates[] = {
+	{ 50, H3LIS331DL_ODR_50Hz },
+	{ 100, H3LIS331DL_ODR_100Hz },
+	{ 400, H3LIS331DL_ODR_400Hz },
+	{ 1000, H3LIS331DL_ODR_1kHz },
+};
+
+struct h3lis331dl_config {
+	struct h3lis331dl_bus bus;
+	struct gpio_dt_spec irq_gpio;
+};
+
+struct h3lis331dl_data {
+	stmdev_ctx_t ctx;
+	const struct h3lis331dl_range *range;
+	int16_t raw[3];
+	uint8_t status;
+#if defined(CONFIG_H3LIS331DL_TRIGGER)
+	const struct device *dev;
+	struct gpio_callback gpio_cb;
+	struct k_work work;
+	sensor_trigger_handler_t drdy_handler;
+	struct sensor_trigger drdy_trigger;
+	//k_cycle_get_32() at the last data ready edge - written by the GPIO interrupt
+	volatile uint32_t drdy_cycles;
+#endif
+};
+
+//ST register driver callbacks - handle is the instance config
+static int32_t h3lis331dl_ctx_write(void *handle, uint8_t reg, const uint8_t *buf, uint16_t len)
+{
+	const struct h3lis331dl_config *cfg = handle;
+
+	return h3lis331dl_bus_write(&cfg->bus, reg, buf, len);
+}
+
+static int32_t h3lis331dl_ctx_read(void *handle, uint8_t reg, uint8_t *buf, uint16_t len)
+{
+	const struct h3lis331dl_config *cfg = handle;
+
+	return h3lis331dl_bus_read(&cfg->bus, reg, buf, len);
+}
+
+static void h3lis331dl_bus_delay(uint32_t ms)
+{
+	k_msleep(ms);
+}
+
+static int h3lis331dl_sample_fetch(const struct device *dev, enum sensor_channel chan)
+{
+	struct h3lis331dl_data *data = dev->data;
+	uint8_t buffer[H3LIS331DL_STATUS_AND_DATA_LEN];
+
+	if (chan != SENSOR_CHAN_ALL && chan != SENSOR_CHAN_ACCEL_XYZ) return -ENOTSUP;
+
+	int ret = h3lis331dl_read_reg(&data->ctx, H3LIS331DL_STATUS_REG, buffer, sizeof(buffer));
+	if (ret != 0) return ret;
+
+	const h3lis331dl_status_reg_t *status = (const h3lis331dl_status_reg_t *)&buffer[0];
+	if (!status->zyxda) return -ENODATA;
+
+	for (int axis = 0; axis < 3; axis++) {
+		data->raw[axis] = (int16_t)sys_get_le16(&buffer[1 + axis * 2]);
+	}
+
+	data->status = 0;
+	if (data->raw[0] >= H3LIS331DL_SATURATED_HIGH_RAW || data->raw[0] <= H3LIS331DL_SATURATED_LOW_RAW) {
+		data->status |= H3LIS331DL_STATUS_X_SATURATED;
+	}
+	if (status->zyxor) data->status |= H3LIS331DL_STATUS_OVERRUN;
+
+	return 0;
+}
+
+static void h3lis331dl_convert(const struct h3lis331dl_data *data, int16_t raw, struct sensor_value *val)
+{
+	//12 bit left justified - micro g per digit * micro m/s^2 per g
+	int64_t micro_ms2 = (int64_t)(raw >> 4) * data->range->ug_per_digit * SENSOR_G / 1000000;
+
+	val->val1 = micro_ms2 / 1000000;
+	val->val2 = micro_ms2 % 1000000;
+}
+
+static int h3lis331dl_channel_get(const struct device *dev, enum sensor_channel chan,
+				  struct sensor_value *val)
+{
+	struct h3lis331dl_data *data = dev->data;
+
+	switch ((int)chan) {
+	case SENSOR_CHAN_ACCEL_X:
+		h3lis331dl_convert(data, data->raw[0], val);
+		break;
+	case SENSOR_CHAN_ACCEL_Y:
+		h3lis331dl_convert(data, data->raw[1], val);
+		break;
+	case SENSOR_CHAN_ACCEL_Z:
+		h3lis331dl_convert(data, data->raw[2], val);
+		break;
+	case SENSOR_CHAN_ACCEL_XYZ:
+		for (int axis = 0; axis < 3; axis++) {
+			h3lis331dl_convert(data, data->raw[axis], &val[axis]);
+		}
+		break;
+	case H3LIS331DL_CHAN_STATUS:
+		val->val1 = data->status;
+		val->val2 = 0;
+		break;
+	default:
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+
+static int h3lis331dl_set_full_scale(struct h3lis331dl_data *data, const struct sensor_value *val)
+{
+	int32_t range_g = sensor_ms2_to_g(val);
+
+	for (int x = 0; x < ARRAY_SIZE(ranges); x++) {
+		if (range_g > ranges[x].range_g) continue;
+
+		int ret = h3lis331dl_full_scale_set(&data->ctx, ranges[x].full_scale);
+		if (ret == 0) data->range = &ranges[x];
+		return ret;
+	}
+
+	return -EINVAL;
+}
+
+static int h3lis331dl_set_rate(struct h3lis331dl_data *data, const struct sensor_value *val)
+{
+	for (int x = 0; x < ARRAY_SIZE(rates); x++) {
+		if (val->val1 == rates[x].hz) return h3lis331dl_data_rate_set(&data->ctx, rates[x].setting);
+	}
+
+	return -EINVAL;
+}
+
+static int h3lis331dl_attr_set(const struct device *dev, enum sensor_channel chan,
+			       enum sensor_attribute attr, const struct sensor_value *val)
+{
+	struct h3lis331dl_data *data = dev->data;
+
+	if (chan != SENSOR_CHAN_ALL && chan != SENSOR_CHAN_ACCEL_XYZ) return -ENOTSUP;
+
+	switch (attr) {
+	case SENSOR_ATTR_FULL_SCALE:
+		return h3lis331dl_set_full_scale(data, val);
+	case SENSOR_ATTR_SAMPLING_FREQUENCY:
+		return h3lis331dl_set_rate(data, val);
+	default:
+		return -ENOTSUP;
+	}
+}
+
+static int h3lis331dl_attr_get(const struct device *dev, enum sensor_channel chan,
+			       enum sensor_attribute attr, struct sensor_value *val)
+{
+	switch ((int)attr) {
+#if defined(CONFIG_H3LIS331DL_TRIGGER)
+	case H3LIS331DL_ATTR_DRDY_CYCLES: {
+		struct h3lis331dl_data *data = dev->data;
+
+		val->val1 = (int32_t)data->drdy_cycles;
+		val->val2 = 0;
+		return 0;
+	}
+#endif
+	default:
+		return -ENOTSUP;
+	}
+}
+
+#if defined(CONFIG_H3LIS331DL_TRIGGER)
+static void h3lis331dl_work_handler(struct k_work *work)
+{
+	struct h3lis331dl_data *data = CONTAINER_OF(work, struct h3lis331dl_data, work);
+
+	if (data->drdy_handler) data->drdy_handler(data->dev, &data->drdy_trigger);
+}
+
+static void h3lis331dl_gpio_callback(const struct device *port, struct gpio_callback *cb, uint32_t pins)
+{
+	struct h3lis331dl_data *data = CONTAINER_OF(cb, struct h3lis331dl_data, gpio_cb);
+
+	//timestamp here - by the time the work item runs the sample is a work queue latency older
+	data->drdy_cycles = k_cycle_get_32();
+	k_work_submit(&data->work);
+}
+
+static int h3lis331dl_trigger_set(const struct device *dev, const struct sensor_trigger *trig,
+				  sensor_trigger_handler_t handler)
+{
+	const struct h3lis331dl_config *cfg = dev->config;
+	struct h3lis331dl_data *data = dev->data;
+
+	if (trig->type != SENSOR_TRIG_DATA_READY) return -ENOTSUP;
+	if (!cfg->irq_gpio.port) return -ENOTSUP;
+
+	gpio_pin_interrupt_configure_dt(&cfg->irq_gpio, GPIO_INT_DISABLE);
+
+	data->drdy_handler = handler;
+	data->drdy_trigger = *trig;
+	if (!handler) return 0;
+
+	int ret = h3lis331dl_pin_int1_route_set(&data->ctx, H3LIS331DL_PAD1_DRDY);
+	if (ret != 0) return ret;
+
+	ret = gpio_pin_interrupt_configure_dt(&cfg->irq_gpio, GPIO_INT_EDGE_TO_ACTIVE);
+	if (ret != 0) return ret;
+
+	//data ready held high from before the edge interrupt was on never makes another edge
+	if (gpio_pin_get_dt(&cfg->irq_gpio) > 0) {
+		data->drdy_cycles = k_cycle_get_32();
+		k_work_submit(&data->work);
+	}
+
+	return 0;
+}
+
+static int h3lis331dl_init_trigger(const struct device *dev)
+{
+	const struct h3lis331dl_config *cfg = dev->config;
+	struct h3lis331dl_data *data = dev->data;
+
+	if (!cfg->irq_gpio.port) return 0;
+	if (!device_is_ready(cfg->irq_gpio.port)) return -ENODEV;
+
+	data->dev = dev;
+	k_work_init(&data->work, h3lis331dl_work_handler);
+
+	int ret = gpio_pin_configure_dt(&cfg->irq_gpio, GPIO_INPUT);
+	if (ret != 0) return ret;
+
+	gpio_init_callback(&data->gpio_cb, h3lis331dl_gpio_callback, BIT(cfg->irq_gpio.pin));
+	return gpio_add_callback(cfg->irq_gpio.port, &data->gpio_cb);
+}
+#endif
+
+static const struct sensor_driver_api h3lis331dl_api = {
+	.attr_set = h3lis331dl_attr_set,
+	.attr_get = h3lis331dl_attr_get,
+#if defined(CONFIG_H3LIS331DL_TRIGGER)
+	.trigger_set = h3lis331dl_trigger_set,
+#endif
+	.sample_fetch = h3lis331dl_sample_fetch,
+	.channel_get = h3lis331dl_channel_get,
+};
+
+static int h3lis331dl_init(const struct device *dev)
+{
+	const struct h3lis331dl_config *cfg = dev->config;
+	struct h3lis331dl_data *data = dev->data;
+	uint8_t id;
+
+	if (!h3lis331dl_bus_is_ready(&cfg->bus)) {
+		LOG_ERR("Bus not ready");
+		return -ENODEV;
+	}
+
+	data->ctx.write_reg = h3lis331dl_ctx_write;
+	data->ctx.read_reg = h3lis331dl_ctx_read;
+	data->ctx.mdelay = h3lis331dl_bus_delay;
+	data->ctx.handle = (void *)cfg;
+
+	k_msleep(BOOT_TIME_MS);
+
+	if (h3lis331dl_device_id_get(&data->ctx, &id) != 0 || id != H3LIS331DL_ID) {
+		LOG_ERR("Not an H3LIS331DL (id 0x%02x)", id);
+		return -ENODEV;
+	}
+
+	//output registers only update once both bytes of the last sample were read
+	int ret = h3lis331dl_block_data_update_set(&data->ctx, PROPERTY_ENABLE);
+	if (ret == 0) ret = h3lis331dl_full_scale_set(&data->ctx, ranges[0].full_scale);
+	if (ret == 0) ret = h3lis331dl_data_rate_set(&data->ctx, H3LIS331DL_ODR_400Hz);
+	if (ret != 0) return ret;
+
+	data->range = &ranges[0];
+
+#if defined(CONFIG_H3LIS331DL_TRIGGER)
+	ret = h3lis331dl_init_trigger(dev);
+#endif
+
+	return ret;
+}
+
+#define H3LIS331DL_DEFINE(inst)								\
+	static struct h3lis331dl_data h3lis331dl_data_##inst;				\
+											\
+	static const struct h3lis331dl_config h3lis331dl_config_##inst = {		\
+		.bus = H3LIS331DL_BUS_DT_SPEC_GET(DT_DRV_INST(inst)),			\
+		.irq_gpio = GPIO_DT_SPEC_INST_GET_OR(inst, irq_gpios, { 0 }),		\
+	};										\
+											\
+	DEVICE_DT_INST_DEFINE(inst, h3lis331dl_init, NULL,				\
+			      &h3lis331dl_data_##inst, &h3lis331dl_config_##inst,	\
+			      POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY, &h3lis331dl_api);
+
+DT_INST_FOREACH_STATUS_OKAY(H3LIS331DL_DEFINE)
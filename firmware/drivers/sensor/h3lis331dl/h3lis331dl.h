@@ -0,0 +1,35 @@
+/*
+ * ST H3LIS331DL +-100 / 200 / 400 g accelerometer - Zephyr sensor driver
+ *
+ * On I2C or SPI (mode 3, up to 10 MHz) - whichever bus the devicetree node sits on
+ * SENSOR_CHAN_ACCEL_X / Y / Z / XYZ in m/s^2
+ * SENSOR_ATTR_SAMPLING_FREQUENCY - 50, 100, 400 or 1000 Hz
+ * SENSOR_ATTR_FULL_SCALE - m/s^2, rounded up to the next of 100 / 200 / 400 g
+ * SENSOR_TRIG_DATA_READY - INT1 on irq-gpios, handler runs on the system work queue
+ * H3LIS331DL_ATTR_DRDY_CYCLES (get only) - when the data ready edge the handler runs for came in
+ * sensor_sample_fetch() returns -ENODATA if the sensor has nothing new since the last fetch
+ */
+
+#ifndef H3LIS331DL_H_
+
+#define H3LIS331DL_H_
+
+#include <zephyr/drivers/sensor.h>
+
+enum h3lis331dl_channel {
+	//val1 holds H3LIS331DL_STATUS_* bits for the last fetched sample
+	H3LIS331DL_CHAN_STATUS = SENSOR_CHAN_PRIV_START,
+};
+
+enum h3lis331dl_attribute {
+	//val1 holds k_cycle_get_32() (as int32_t) taken in the INT1 interrupt - the handler itself
+	//runs after system work queue latency. Edges coalesced into one handler call give the newest
+	H3LIS331DL_ATTR_DRDY_CYCLES = SENSOR_ATTR_PRIV_START,
+};
+
+//X at the end of the current range - real value is larger
+#define H3LIS331DL_STATUS_X_SATURATED	BIT(0)
+//sensor replaced a sample that was never fetched
+#define H3LIS331DL_STATUS_OVERRUN		BIT(1)
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ * ST H3LIS331DL i2c emulator - see h3lis331dl_emul.h
+ */
+
+#define DT_DRV_COMPAT st_h3lis331dl
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/logging/log.h>
+#include <math.h>
+
+#include "h3lis331dl_emul.h"
+#include "h3lis331dl_reg.h"
+
+LOG_MODULE_REGISTER(h3lis331dl_emul, CONFIG_SENSOR_LOG_LEVEL);
+
+#define REG_COUNT				0x40
+//MSB of the register address turns on auto increment
+#define AUTO_INCREMENT			0x80
+
+#define CTRL_REG1_DEFAULT		0x07
+#define CTRL_REG2_BOOT			0x80
+#define CTRL_REG3_I1_CFG_MASK	0x03
+#define STATUS_ZYXDA			0x08
+#define STATUS_ZYXOR			0x80
+
+#define STANDARD_GRAVITY		9.80665f
+
+//X / Y / Z counts are 12 bit left justified
+#define COUNT_MAX				32752
+#define COUNT_MIN				-32768
+
+struct h3lis331dl_emul_cfg;
+
+struct h3lis331dl_emul_data {
+	struct i2c_emul emul_i2c;
+	const struct h3lis331dl_emul_cfg *cfg;
+	struct k_spinlock lock;
+	uint8_t regs[REG_COUNT];
+	struct k_timer sample_timer;
+	uint32_t odr_hz;
+	const struct h3lis331dl_emul_profile *profile;
+	uint32_t profile_samples;	//samples generated since the profile started
+	float angle;				//rotation angle, radians
+};
+
+struct h3lis331dl_emul_cfg {
+	const char *i2c_label;
+	struct h3lis331dl_emul_data *data;
+	uint16_t addr;
+	struct gpio_dt_spec irq_gpio;
+};
+
+static void set_int1(struct h3lis331dl_emul_data *data, int level)
+{
+	const struct gpio_dt_spec *irq_gpio = &data->cfg->irq_gpio;
+
+	if (irq_gpio->port) gpio_emul_input_set(irq_gpio->port, irq_gpio->pin, level);
+}
+
+//CTRL_REG1 power mode 7:5 must be normal (001) - data rate 4:3 is 50 / 100 / 400 / 1000 Hz
+static uint32_t odr_from_regs(const uint8_t *regs)
+{
+	static const uint32_t rates[] = { 50, 100, 400, 1000 };
+	uint8_t ctrl_reg1 = regs[H3LIS331DL_CTRL_REG1];
+
+	if ((ctrl_reg1 >> 5) != 1) return 0;
+	return rates[(ctrl_reg1 >> 3) & 0x03];
+}
+
+//12 bit sensitivity for CTRL_REG4 full scale 5:4
+static float ug_per_digit(const uint8_t *regs)
+{
+	switch ((regs[H3LIS331DL_CTRL_REG4] >> 4) & 0x03) {
+	case H3LIS331DL_200g:
+		return 98000.0f;
+	case H3LIS331DL_400g:
+		return 195000.0f;
+	default:
+		return 49000.0f;
+	}
+}
+
+static void put_axis(uint8_t *regs, uint8_t reg, float accel_g)
+{
+	float counts = accel_g * 1000000.0f / ug_per_digit(regs) * 16.0f;
+	int32_t value = (int32_t)lroundf(counts) & ~0x0f;
+
+	if (value > COUNT_MAX) value = COUNT_MAX;
+	if (value < COUNT_MIN) value = COUNT_MIN;
+
+	regs[reg] = (uint8_t)value;
+	regs[reg + 1] = (uint8_t)(value >> 8);
+}
+
+//spin speed (rad/s) and its rate of change at time t into the profile
+static void profile_speed(const struct h3lis331dl_emul_profile *profile, float t, float *rad_per_s,
+			  float *rad_per_s2)
+{
+	const float rpm_to_rad = 2.0f * (float)M_PI / 60.0f;
+	float total = 0.0f;
+
+	for (int x = 0; x < profile->segment_count; x++) total += profile->segments[x].duration_ms / 1000.0f;
+	if (profile->repeat && total > 0.0f) t = fmodf(t, total);
+
+	for (int x = 0; x < profile->segment_count; x++) {
+		const struct h3lis331dl_emul_segment *segment = &profile->segments[x];
+		float duration = segment->duration_ms / 1000.0f;
+
+		if (t < duration || x == profile->segment_count - 1) {
+			float fraction = duration > 0.0f && t < duration ? t / duration : 1.0f;
+
+			*rad_per_s = (segment->rpm_start + (segment->rpm_end - segment->rpm_start) * fraction) * rpm_to_rad;
+			*rad_per_s2 = t < duration && duration > 0.0f ?
+				(segment->rpm_end - segment->rpm_start) * rpm_to_rad / duration : 0.0f;
+			return;
+		}
+
+		t -= duration;
+	}
+
+	*rad_per_s = 0.0f;
+	*rad_per_s2 = 0.0f;
+}
+
+//sensor X radial (centripetal), Y tangential, Z along the spin axis
+static void generate_sample(struct h3lis331dl_emul_data *data)
+{
+	const struct h3lis331dl_emul_profile *profile = data->profile;
+	float x_g = 0.0f;
+	float y_g = 0.0f;
+	float z_g = 1.0f;
+
+	if (profile) {
+		float t = (float)data->profile_samples / data->odr_hz;
+		float rad_per_s;
+		float rad_per_s2;
+		float tilt = profile->tilt_deg * (float)M_PI / 180.0f;
+
+		profile_speed(profile, t, &rad_per_s, &rad_per_s2);
+
+		//gravity in the spin plane turns once per rotation against the spin
+		x_g = (rad_per_s * rad_per_s * profile->radius_m) / STANDARD_GRAVITY + sinf(tilt) * cosf(data->angle);
+		y_g = (rad_per_s2 * profile->radius_m) / STANDARD_GRAVITY - sinf(tilt) * sinf(data->angle);
+		z_g = cosf(tilt);
+
+		data->angle = fmodf(data->angle + rad_per_s / data->odr_hz, 2.0f * (float)M_PI);
+		data->profile_samples++;
+	}
+
+	put_axis(data->regs, H3LIS331DL_OUT_X_L, x_g);
+	put_axis(data->regs, H3LIS331DL_OUT_X_L + 2, y_g);
+	put_axis(data->regs, H3LIS331DL_OUT_X_L + 4, z_g);
+}
+
+static void sample_timer_expiry(struct k_timer *timer)
+{
+	struct h3lis331dl_emul_data *data = CONTAINER_OF(timer, struct h3lis331dl_emul_data, sample_timer);
+	bool drdy;
+
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	generate_sample(data);
+
+	uint8_t *status = &data->regs[H3LIS331DL_STATUS_REG];
+	if (*status & STATUS_ZYXDA) *status |= STATUS_ZYXOR;
+	*status |= STATUS_ZYXDA;
+
+	drdy = (data->regs[H3LIS331DL_CTRL_REG3] & CTRL_REG3_I1_CFG_MASK) == H3LIS331DL_PAD1_DRDY;
+
+	k_spin_unlock(&data->lock, key);
+
+	if (drdy) set_int1(data, 1);
+}
+
+//called with the lock held - CTRL_REG1 changes restart the sample clock
+static void update_sample_timer(struct h3lis331dl_emul_data *data)
+{
+	uint32_t odr_hz = odr_from_regs(data->regs);
+
+	if (odr_hz == data->odr_hz) return;
+	data->odr_hz = odr_hz;
+
+	if (odr_hz == 0) {
+		k_timer_stop(&data->sample_timer);
+	} else {
+		k_timer_start(&data->sample_timer, K_USEC(1000000 / odr_hz), K_USEC(1000000 / odr_hz));
+	}
+}
+
+static void write_reg(struct h3lis331dl_emul_data *data, uint8_t reg, uint8_t value)
+{
+	if (reg >= REG_COUNT) return;
+
+	switch (reg) {
+	case H3LIS331DL_WHO_AM_I:
+	case H3LIS331DL_STATUS_REG:
+		return;		//read only
+	case H3LIS331DL_CTRL_REG2:
+		value &= ~CTRL_REG2_BOOT;	//reboot is instant
+		break;
+	default:
+		if (reg >= H3LIS331DL_OUT_X_L && reg <= H3LIS331DL_OUT_X_L + 5) return;
+		break;
+	}
+
+	data->regs[reg] = value;
+	if (reg == H3LIS331DL_CTRL_REG1) update_sample_timer(data);
+}
+
+static int h3lis331dl_emul_transfer(struct i2c_emul *emul, struct i2c_msg *msgs, int num_msgs, int addr)
+{
+	struct h3lis331dl_emul_data *data = CONTAINER_OF(emul, struct h3lis331dl_emul_data, emul_i2c);
+	bool auto_increment = false;
+	bool address_set = false;
+	bool sample_read = false;
+	uint8_t reg = 0;
+
+	if (addr != data->cfg->addr) return -EIO;
+
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	for (int x = 0; x < num_msgs; x++) {
+		struct i2c_msg *msg = &msgs[x];
+		uint32_t start = 0;
+
+		if (!(msg->flags & I2C_MSG_READ)) {
+			//first byte written is the register address
+			if (!address_set && msg->len > 0) {
+				reg = msg->buf[0] & ~AUTO_INCREMENT;
+				auto_increment = msg->buf[0] & AUTO_INCREMENT;
+				address_set = true;
+				start = 1;
+			}
+
+			for (uint32_t y = start; y < msg->len; y++) {
+				write_reg(data, reg, msg->buf[y]);
+				if (auto_increment) reg++;
+			}
+		} else {
+			for (uint32_t y = 0; y < msg->len; y++) {
+				msg->buf[y] = reg < REG_COUNT ? data->regs[reg] : 0;
+				if (reg == H3LIS331DL_OUT_X_L + 5) sample_read = true;
+				if (auto_increment) reg++;
+			}
+		}
+	}
+
+	//data ready (and overrun) clear once the whole sample has been read
+	if (sample_read) data->regs[H3LIS331DL_STATUS_REG] &= ~(STATUS_ZYXDA | STATUS_ZYXOR);
+
+	k_spin_unlock(&data->lock, key);
+
+	if (sample_read) set_int1(data, 0);
+
+	return 0;
+}
+
+int h3lis331dl_emul_set_profile(const struct emul *target, const struct h3lis331dl_emul_profile *profile)
+{
+	const struct h3lis331dl_emul_cfg *cfg = target->cfg;
+	struct h3lis331dl_emul_data *data = cfg->data;
+
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+	data->profile = profile;
+	data->profile_samples = 0;
+	data->angle = 0.0f;
+	k_spin_unlock(&data->lock, key);
+
+	return 0;
+}
+
+static struct i2c_emul_api h3lis331dl_emul_api = {
+	.transfer = h3lis331dl_emul_transfer,
+};
+
+static int h3lis331dl_emul_init(const struct emul *target, const struct device *parent)
+{
+	const struct h3lis331dl_emul_cfg *cfg = target->cfg;
+	struct h3lis331dl_emul_data *data = cfg->data;
+
+	data->cfg = cfg;
+	data->emul_i2c.api = &h3lis331dl_emul_api;
+	data->emul_i2c.addr = cfg->addr;
+
+	data->regs[H3LIS331DL_WHO_AM_I] = H3LIS331DL_ID;
+	data->regs[H3LIS331DL_CTRL_REG1] = CTRL_REG1_DEFAULT;
+	k_timer_init(&data->sample_timer, sample_timer_expiry, NULL);
+
+	return i2c_emul_register(parent, target->dev_label, &data->emul_i2c);
+}
+
+#define H3LIS331DL_EMUL(n)								\
+	static struct h3lis331dl_emul_data h3lis331dl_emul_data_##n;			\
+											\
+	static const struct h3lis331dl_emul_cfg h3lis331dl_emul_cfg_##n = {		\
+		.i2c_label = DT_INST_BUS_LABEL(n),					\
+		.data = &h3lis331dl_emul_data_##n,					\
+		.addr = DT_INST_REG_ADDR(n),						\
+		.irq_gpio = GPIO_DT_SPEC_INST_GET_OR(n, irq_gpios, { 0 }),		\
+	};										\
+											\
+	EMUL_DEFINE(h3lis331dl_emul_init, DT_DRV_INST(n), &h3lis331dl_emul_cfg_##n)
+
+DT_INST_FOREACH_STATUS_OKAY(H3LIS331DL_EMUL)
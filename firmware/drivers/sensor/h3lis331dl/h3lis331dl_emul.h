@@ -0,0 +1,35 @@
+/*
+ * ST H3LIS331DL i2c emulator
+ *
+ * Register level model of the chip for the i2c emulation controller: WHO_AM_I, CTRL_REG1..5,
+ * STATUS_REG and OUT_X..OUT_Z with auto increment. A new sample is generated every output data
+ * rate period from the active profile, STATUS_REG ZYXDA / ZYXOR track reads and INT1 (irq-gpios,
+ * on a gpio emulator) follows data ready when it is routed there - so drivers see the same timing
+ * they would on hardware, and runs are repeatable.
+ */
+
+#ifndef H3LIS331DL_EMUL_H_
+
+#define H3LIS331DL_EMUL_H_
+
+#include <zephyr/drivers/emul.h>
+
+//spin speed ramps linearly from rpm_start to rpm_end over the segment
+struct h3lis331dl_emul_segment {
+	uint32_t duration_ms;
+	float rpm_start;
+	float rpm_end;
+};
+
+struct h3lis331dl_emul_profile {
+	const struct h3lis331dl_emul_segment *segments;
+	int segment_count;
+	float radius_m;				//sensor distance from the spin axis
+	float tilt_deg;				//spin axis away from vertical - gravity ripple on X / Y
+	bool repeat;				//start over after the last segment (else hold its end speed)
+};
+
+//replaces the active profile and restarts it from the first segment - profile must stay valid
+int h3lis331dl_emul_set_profile(const struct emul *target, const struct h3lis331dl_emul_profile *profile);
+
+#endif
@@ -1,194 +1,450 @@
 #include "accel.h"
-
-#include "h3lis331dl_reg.h"
-
-// https://github.com/STMicroelectronics/h3lis331dl-pid/tree/d2404b332f7ba6f517b6b959e09014d429cac9ae?tab=readme-ov-file
-// https://github.com/STMicroelectronics/STMems_Standard_C_drivers/tree/master/h3lis331dl_STdC/examples
+#include "accel_backend.h"
+#include "sensor_publish.h"
+#include "accel_ring.h"
+#include "rpm_estimator.h"
+#include "tilt_comp.h"
+#include "phase_sync.h"
+#include "impact_gate.h"
+#include "accel_cal.h"
+#include "melty_ble.h"
 
 #include <zephyr/types.h>
 #include <zephyr/sys/printk.h>
-#include <zephyr/sys/byteorder.h>
 #include <zephyr/kernel.h>
-#include <zephyr/drivers/gpio.h>
-#include <zephyr/settings/settings.h>
 
-#include <zephyr/drivers/i2c.h>
-
-#include <string.h>
-#include <stdio.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <math.h>
 
-struct k_mutex accel_mutex;
-
-#define I2C_ADDRESS 0x19
+#if defined(CONFIG_MELTY_ACCEL_READ_BENCHMARK) || defined(CONFIG_MELTY_ACCEL_CPU_BENCHMARK)
+#include <soc.h>
+#endif
 
-/* Private macro -------------------------------------------------------------*/
 #define BOOT_TIME 5 // ms
-/* Private variables ---------------------------------------------------------*/
-static int16_t data_raw_acceleration[3];
-static float acceleration_mg[3];
-static uint8_t whoamI;
-static uint8_t tx_buffer[1000];
-
-#if DT_NODE_HAS_STATUS(DT_NODELABEL(i2c1), okay)
-#define I2C_DEV_NODE DT_NODELABEL(i2c1)
+
+#if defined(CONFIG_MELTY_ACCEL_ODR_1000HZ)
+#define ACCEL_ODR_HZ        1000
 #else
-#error "Please set the correct I2C device"
+#define ACCEL_ODR_HZ        400
 #endif
 
-uint32_t i2c_cfg = I2C_SPEED_SET(I2C_SPEED_STANDARD) | I2C_MODE_CONTROLLER;
+//if data ready doesn't show up in this many sample periods read the status register anyway
+//(covers a missed edge - or INT1 not wired at all)
+#define DRDY_TIMEOUT_PERIODS  2
+#define DRDY_TIMEOUT_US       (DRDY_TIMEOUT_PERIODS * 1000000 / ACCEL_ODR_HZ)
+
+#define SAMPLE_RATE_WINDOW_MS 1000
+
+//m/s^2 per normalized count
+#define MS2_PER_RAW           (ACCEL_MG_PER_RAW * 9.80665f / 1000.0f)
+
+#define CPU_BENCHMARK_REPORT_S        5
+
+//full scale switching
+//move up a range above 80% of the current one
+#define RANGE_UP_FRACTION             0.8f
+//move down a range once below 35% of the next one down for a while (hysteresis vs. moving up)
+#define RANGE_DOWN_FRACTION           0.35f
+#define RANGE_DOWN_SAMPLES            64
+//samples after a switch that may still have been converted on the old range
+#define RANGE_SETTLE_SAMPLES          2
+
+#define START_RANGE_INDEX 1   //200 g
+
+static struct sensor_publication accel_publication;
+//rpm estimator output - latency compensated value used by the control path
+static struct sensor_publication predicted_publication;
+//spin up / down rate from tangential acceleration
+static struct sensor_publication spin_rate_publication;
+
+static struct accel_ring sample_ring;
+
+//index into accel_backend_ranges_g - written by the sampling thread, read by the decoder
+static volatile int range_index = START_RANGE_INDEX;
+static atomic_t range_settle_samples;
 
-const struct device *i2c_dev = DEVICE_DT_GET(I2C_DEV_NODE);
+//set by data ready - timestamp for samples read by the sampling thread
+static volatile uint32_t drdy_cycles;
 
-stmdev_ctx_t dev_ctx;
+static K_SEM_DEFINE(drdy_sem, 0, 1);
 
-static float sampled_accel_value_g = 0.0f;
+//written only by whichever context decodes samples - each field is a single word so readers see whole values
+static struct accel_stats stats;
 
-void update_accel_value()
+#if defined(CONFIG_MELTY_ACCEL_CPU_BENCHMARK)
+static uint32_t estimator_cycles = 0;
+static uint32_t estimator_updates = 0;
+#endif
+
+#if defined(CONFIG_MELTY_ACCEL_ASYNC_READ)
+//cleared if the backend can't read without blocking - blocking reads are used instead
+static bool async_supported = true;
+static K_SEM_DEFINE(sample_sem, 0, 1);
+
+static void async_read_done(int result, const struct accel_backend_sample *sample, uint32_t timestamp_cycles);
+#endif
+
+static void accel_ready(uint32_t timestamp_cycles)
 {
-  static float accel = 0;
+  drdy_cycles = timestamp_cycles;
+
+#if defined(CONFIG_MELTY_ACCEL_ASYNC_READ)
+  if (async_supported) {
+    //-EBUSY - previous read still on the bus, its sample is about to be replaced and overrun will count it
+    int ret = accel_backend_read_async(timestamp_cycles, async_read_done);
+    if (ret == 0 || ret == -EBUSY) return;
+    if (ret == -ENOTSUP) async_supported = false;
+  }
+#endif
+  k_sem_give(&drdy_sem);
+}
 
-  /* Read acceleration data */
-  memset(data_raw_acceleration, 0x00, 3 * sizeof(int16_t));
-  h3lis331dl_acceleration_raw_get(&dev_ctx, data_raw_acceleration);
+static void update_sample_rate(void)
+{
+  static uint32_t window_start_ms = 0;
+  static uint32_t window_samples = 0;
+  uint32_t now_ms = k_uptime_get_32();
 
-  accel = h3lis331dl_from_fs200_to_mg(data_raw_acceleration[0]);
-  accel = accel / 1000.0f;
+  window_samples++;
 
-  k_mutex_lock(&accel_mutex, K_FOREVER);
-  if (sampled_accel_value_g == 0) sampled_accel_value_g = accel;
-  
-  //slight moving average smoothing on accel
-  sampled_accel_value_g = sampled_accel_value_g * 0.5f + accel * .5f;
-  k_mutex_unlock(&accel_mutex);
+  if (now_ms - window_start_ms >= SAMPLE_RATE_WINDOW_MS) {
+    stats.sample_rate_hz = window_samples * 1000 / (now_ms - window_start_ms);
+    window_start_ms = now_ms;
+    window_samples = 0;
+  }
 }
 
-static float current_accel = 0.0f;
+void get_accel_stats(struct accel_stats *stats_out)
+{
+  *stats_out = stats;
+  stats_out->bus_transactions = accel_backend_bus_transactions();
+}
 
-float get_accel_g()
+//queue a sample for the estimator and publish it - returns false if it was dropped
+static bool decode_accel_sample(const struct accel_backend_sample *sample, uint32_t timestamp_cycles)
 {
-  k_mutex_lock(&accel_mutex, K_FOREVER);
-  current_accel = sampled_accel_value_g;
-  k_mutex_unlock(&accel_mutex);
-  return current_accel;
+  float accel;
+
+  //range just changed - this one may have been converted on the old range
+  if (atomic_get(&range_settle_samples) > 0) {
+    atomic_dec(&range_settle_samples);
+    return false;
+  }
+
+  //overrun - sensor wrote a new sample over one we never read
+  if (sample->overrun) stats.dropped_samples++;
+  stats.samples++;
+  update_sample_rate();
+
+  struct accel_ring_sample ring_sample = {
+    .timestamp_cycles = timestamp_cycles,
+    .x = sample->x,
+    .y = sample->y,
+    .z = sample->z,
+    .saturated = sample->saturated,
+  };
+  accel_cal_apply(&ring_sample);
+  accel_ring_put(&sample_ring, &ring_sample);
+
+  if (ring_sample.saturated) stats.saturated_samples++;
+
+  accel = ring_sample.x * ACCEL_MG_PER_RAW / 1000.0f;
+
+  //unfiltered - smoothing is up to the rpm estimator
+  sensor_publish(&accel_publication, accel, ring_sample.x);
+
+  return true;
 }
 
-int32_t platform_write(void *handle, uint8_t Reg, const uint8_t *Bufp, uint16_t len)
+//blocking read of the latest sample
+static bool update_accel_value(uint32_t timestamp_cycles)
 {
+  struct accel_backend_sample sample;
 
-  uint8_t buf[len + 1]; // Buffer to hold the register address and the data to write
+  if (accel_backend_read(&sample) != 1) return false;
 
-  Reg |= 0x80;
+  return decode_accel_sample(&sample, timestamp_cycles);
+}
 
-  // First byte is the register address
-  buf[0] = Reg;
+//true if the sample goes on to the rpm estimator
+static bool impact_gate(const struct accel_ring_sample *sample)
+{
+  switch (impact_gate_check(sample->x, sample->timestamp_cycles, rpm_estimator_predict(sample->timestamp_cycles))) {
+  case IMPACT_GATE_HIT:
+    stats.impacts++;
+    //fall through
+  case IMPACT_GATE_REJECT:
+    stats.rejected_samples++;
+    return false;
+  case IMPACT_GATE_RESTART:
+    rpm_estimator_reset();
+    tilt_comp_reset();
+#if defined(CONFIG_MELTY_ACCEL_PHASE_SYNC)
+    phase_sync_reset();
+#endif
+    return true;
+  case IMPACT_GATE_ACCEPT:
+    break;
+  }
 
-  // Copy the data to write into the buffer, starting from the second byte
-  memcpy(&buf[1], Bufp, len);
+  return true;
+}
 
-  // Perform the I2C write operation
-  int ret = i2c_write(i2c_dev, buf, len + 1, I2C_ADDRESS);
-  if (ret < 0)
-  {
-    printk("Failed to write data to register\n");
-    return ret;
+static void set_accel_range(int index)
+{
+  //settle first - a read finishing straight after the switch must not get through
+  atomic_set(&range_settle_samples, RANGE_SETTLE_SAMPLES);
+
+  if (accel_backend_set_range(accel_backend_ranges_g[index]) != 0) {
+    atomic_set(&range_settle_samples, 0);
+    return;
   }
 
-  return 0; // Success
+  range_index = index;
+  stats.range_g = accel_backend_ranges_g[index];
+  stats.range_switches++;
 }
 
-int32_t platform_read(void *handle, uint8_t Reg, uint8_t *Bufp, uint16_t len)
+//fraction of a range's full scale in normalized counts
+static int32_t range_fraction_raw(int index, float fraction)
 {
+  return (int32_t)(accel_backend_ranges_g[index] * ACCEL_ONE_G_RAW * fraction);
+}
 
-  Reg |= 0x80;
+//picks the range for the next samples - up straight away, down only after a run of small readings
+static int choose_accel_range(const struct accel_ring_sample *sample, int current_index)
+{
+  static uint32_t small_in_row = 0;
+  int32_t magnitude = sample->x < 0 ? -sample->x : sample->x;
 
-  // Write the register address
-  int ret = i2c_write(i2c_dev, &Reg, 1, I2C_ADDRESS);
-  if (ret < 0)
-  {
-    printk("Failed to write register address\n");
-    return ret;
+  if (sample->saturated || magnitude > range_fraction_raw(current_index, RANGE_UP_FRACTION)) {
+    small_in_row = 0;
+    return current_index + 1 < accel_backend_range_count ? current_index + 1 : current_index;
   }
 
-  // Read from the register
-  ret = i2c_read(i2c_dev, Bufp, len, I2C_ADDRESS);
-  if (ret < 0)
-  {
-    printk("Failed to read data\n");
-    return ret;
+  if (current_index == 0 || magnitude >= range_fraction_raw(current_index - 1, RANGE_DOWN_FRACTION)) {
+    small_in_row = 0;
+    return current_index;
   }
 
-  return 0; // Success
+  if (++small_in_row < RANGE_DOWN_SAMPLES) return current_index;
+
+  small_in_row = 0;
+  return current_index - 1;
 }
 
-static void platform_delay(uint32_t ms)
+//estimator gets rotation averages once the bot spins fast enough for them (and they have ripple
+//to cancel), single samples otherwise
+static void update_rpm_estimate(const struct accel_ring_sample *sample)
 {
-  k_sleep(K_MSEC(ms));
+#if defined(CONFIG_MELTY_ACCEL_PHASE_SYNC)
+  int32_t estimator_raw;
+  uint32_t estimator_cycles;
+
+  float rad_per_s = accel_raw_to_rad_per_s(rpm_estimator_predict(sample->timestamp_cycles), get_radius_raw());
+  switch (phase_sync_select(sample->x, sample->timestamp_cycles, rad_per_s, &estimator_raw, &estimator_cycles)) {
+  case PHASE_SYNC_FEED_RESTART:
+    rpm_estimator_reset();
+    rpm_estimator_update(estimator_raw, estimator_cycles);
+    break;
+  case PHASE_SYNC_FEED_UPDATE:
+    rpm_estimator_update(estimator_raw, estimator_cycles);
+    break;
+  case PHASE_SYNC_FEED_NONE:
+    break;
+  }
+#else
+  rpm_estimator_update(sample->x, sample->timestamp_cycles);
+#endif
 }
 
-void init_accel()
+static void update_accel_prediction(void)
 {
-  k_mutex_init(&accel_mutex);
+  struct accel_ring_sample sample;
+  int next_range_index = range_index;
 
-  i2c_configure(i2c_dev, i2c_cfg);
+#if defined(CONFIG_MELTY_ACCEL_CPU_BENCHMARK)
+  uint32_t start_cycles = DWT->CYCCNT;
+  uint32_t updates = 0;
+#endif
 
-  /* Initialize mems driver interface */
-  dev_ctx.write_reg = platform_write;
-  dev_ctx.read_reg = platform_read;
-  dev_ctx.mdelay = platform_delay;
-  dev_ctx.handle = NULL;
+  //estimator runs on every sample, even if several were decoded since the thread last ran
+  while (accel_ring_get(&sample_ring, &sample)) {
+    next_range_index = choose_accel_range(&sample, next_range_index);
+    accel_cal_update(&sample);
 
-  /* Wait sensor boot time */
-  platform_delay(BOOT_TIME);
+    //take out once per rotation gravity ripple before anything judges the sample
+    tilt_comp_apply(&sample, rpm_estimator_predict(sample.timestamp_cycles), get_radius_raw());
 
-  /* Check device ID */
-  h3lis331dl_device_id_get(&dev_ctx, &whoamI);
+    //clipped - the real value is unknown, let the estimator coast on its own extrapolation
+    if (sample.saturated) continue;
+    if (!impact_gate(&sample)) continue;
+    update_rpm_estimate(&sample);
+#if defined(CONFIG_MELTY_ACCEL_CPU_BENCHMARK)
+    updates++;
+#endif
+  }
 
-  if (whoamI != H3LIS331DL_ID)
+#if defined(CONFIG_MELTY_ACCEL_CPU_BENCHMARK)
+  estimator_cycles += DWT->CYCCNT - start_cycles;
+  estimator_updates += updates;
+#endif
+
+  //parameters built now stay in use until the next sample - aim for the middle of that window
+  uint32_t target_cycles = k_cycle_get_32() + sys_clock_hw_cycles_per_sec() / ACCEL_ODR_HZ / 2;
+  int32_t predicted_raw = rpm_estimator_predict(target_cycles);
+
+  sensor_publish(&predicted_publication, predicted_raw * ACCEL_MG_PER_RAW / 1000.0f, predicted_raw);
+
+  //angular acceleration = tangential / r
+  float tangential_raw = tilt_comp_get_tangential_raw();
+  uint16_t radius_raw = get_radius_raw();
+  float rpm_per_s = 0.0f;
+  if (radius_raw != 0) {
+    float rad_per_s2 = tangential_raw * MS2_PER_RAW / (radius_raw / 100000.0f);
+    rpm_per_s = rad_per_s2 * 60.0f / (2.0f * (float)M_PI);
+  }
+  sensor_publish(&spin_rate_publication, rpm_per_s, (int32_t)tangential_raw);
+
+#if defined(CONFIG_MELTY_ACCEL_AUTO_RANGE)
+  if (next_range_index != range_index) set_accel_range(next_range_index);
+#endif
+}
+
+#if defined(CONFIG_MELTY_ACCEL_CPU_BENCHMARK)
+static uint32_t callback_cycles = 0;
+
+static void report_cpu_use(void)
+{
+  static uint32_t window_start = 0;
+  static uint64_t window_start_thread_cycles = 0;
+  k_thread_runtime_stats_t thread_stats;
+  uint32_t now = k_cycle_get_32();
+  uint32_t window_cycles = now - window_start;
+
+  if (window_cycles < sys_clock_hw_cycles_per_sec() * CPU_BENCHMARK_REPORT_S) return;
+
+  k_thread_runtime_stats_get(k_current_get(), &thread_stats);
+
+  //thread time is in system clock cycles, callback time (ISR - not charged to any thread) in DWT cycles
+  uint32_t thread_permille = (uint32_t)((thread_stats.execution_cycles - window_start_thread_cycles) * 1000 / window_cycles);
+  uint32_t callback_permille = (uint32_t)((uint64_t)callback_cycles * 1000 / SystemCoreClock / CPU_BENCHMARK_REPORT_S);
+  bool async = false;
+#if defined(CONFIG_MELTY_ACCEL_ASYNC_READ)
+  async = async_supported;
+#endif
+
+  printk("Accel CPU (%s @ %u Hz): thread %u.%u%% callback %u.%u%%\n", async ? "async" : "blocking", stats.sample_rate_hz,
+    thread_permille / 10, thread_permille % 10, callback_permille / 10, callback_permille % 10);
+
+  if (estimator_updates != 0) {
+    printk("RPM estimator: %u cycles per sample\n", estimator_cycles / estimator_updates);
+  }
+
+  window_start = now;
+  window_start_thread_cycles = thread_stats.execution_cycles;
+  callback_cycles = 0;
+  estimator_cycles = 0;
+  estimator_updates = 0;
+}
+#endif
+
+#if defined(CONFIG_MELTY_ACCEL_ASYNC_READ)
+static void async_read_done(int result, const struct accel_backend_sample *sample, uint32_t timestamp_cycles)
+{
+#if defined(CONFIG_MELTY_ACCEL_CPU_BENCHMARK)
+  uint32_t start_cycles = DWT->CYCCNT;
+#endif
+
+  if (result == 1 && decode_accel_sample(sample, timestamp_cycles)) k_sem_give(&sample_sem);
+
+#if defined(CONFIG_MELTY_ACCEL_CPU_BENCHMARK)
+  callback_cycles += DWT->CYCCNT - start_cycles;
+#endif
+}
+#endif
+
+bool wait_accel_sample(void)
+{
+  bool new_sample;
+
+#if defined(CONFIG_MELTY_ACCEL_ASYNC_READ)
+  if (async_supported) {
+    new_sample = k_sem_take(&sample_sem, K_USEC(DRDY_TIMEOUT_US)) == 0;
+    //missed data ready edge - DRDY stays high until read, so kick a read to get it going again
+    if (!new_sample) {
+      stats.missed_interrupts++;
+      accel_backend_read_async(k_cycle_get_32(), async_read_done);
+    }
+  } else
+#endif
   {
-    while (1)
-    {
-      platform_delay(BOOT_TIME);
+    uint32_t timestamp_cycles;
+
+    if (k_sem_take(&drdy_sem, K_USEC(DRDY_TIMEOUT_US)) == 0) {
+      timestamp_cycles = drdy_cycles;
+    } else {
+      stats.missed_interrupts++;
+      timestamp_cycles = k_cycle_get_32();
     }
+    //timeout still falls through to a status check in case a data ready edge was missed
+    new_sample = update_accel_value(timestamp_cycles);
   }
 
-  /* Enable Block Data Update */
-  h3lis331dl_block_data_update_set(&dev_ctx, PROPERTY_ENABLE);
-  /* Set full scale */
-  h3lis331dl_full_scale_set(&dev_ctx, H3LIS331DL_200g);
-  /* Set Output Data Rate */
-  h3lis331dl_data_rate_set(&dev_ctx, H3LIS331DL_ODR_5Hz);
+  if (new_sample) update_accel_prediction();
+
+#if defined(CONFIG_MELTY_ACCEL_CPU_BENCHMARK)
+  report_cpu_use();
+#endif
+
+  return new_sample;
 }
 
-void accel_data_polling(void)
+void get_accel_sample(struct sensor_sample *sample)
 {
+  sensor_read(&accel_publication, sample);
+}
 
-  /* Read samples in polling mode (no int) */
-  while (1)
-  {
+float get_accel_g()
+{
+  struct sensor_sample sample;
+  sensor_read(&predicted_publication, &sample);
+  return sample.value;
+}
 
-    /* Read output only if new value is available */
-    h3lis331dl_reg_t reg;
-    h3lis331dl_status_reg_get(&dev_ctx, &reg.status_reg);
+float get_spin_rate_rpm_s(void)
+{
+  struct sensor_sample sample;
+  sensor_read(&spin_rate_publication, &sample);
+  return sample.value;
+}
 
-    if (reg.status_reg.zyxda)
+int32_t get_accel_raw()
+{
+  struct sensor_sample sample;
+  sensor_read(&predicted_publication, &sample);
+  return sample.raw;
+}
+
+void init_accel()
+{
+#if defined(CONFIG_MELTY_ACCEL_READ_BENCHMARK) || defined(CONFIG_MELTY_ACCEL_CPU_BENCHMARK)
+  //start DWT cycle counter
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+  int ret = accel_backend_init(ACCEL_ODR_HZ, accel_backend_ranges_g[START_RANGE_INDEX], accel_ready);
+  if (ret != 0)
+  {
+    printk("Accel init failed (%d)\n", ret);
+    while (1)
     {
-      /* Read acceleration data */
-      memset(data_raw_acceleration, 0x00, 3 * sizeof(int16_t));
-      h3lis331dl_acceleration_raw_get(&dev_ctx, data_raw_acceleration);
-
-      acceleration_mg[0] =
-          h3lis331dl_from_fs200_to_mg(data_raw_acceleration[0]);
-      acceleration_mg[1] =
-          h3lis331dl_from_fs200_to_mg(data_raw_acceleration[1]);
-      acceleration_mg[2] =
-          h3lis331dl_from_fs200_to_mg(data_raw_acceleration[2]);
-
-      sprintf((char *)tx_buffer,
-              "Acceleration [mg]:%4.2f\t%4.2f\t%4.2f\r\n",
-              acceleration_mg[0], acceleration_mg[1], acceleration_mg[2]);
+      k_sleep(K_MSEC(BOOT_TIME));
     }
   }
-}
\ No newline at end of file
+
+  stats.range_g = accel_backend_ranges_g[START_RANGE_INDEX];
+}
@@ -1,4 +1,42 @@
-void accel_data_polling(void);
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sensor_publish.h"
+
+//raw accel values outside accel.c are normalized to 100 g range counts (3.0625 mg)
+//whatever range the sensor is switched to
+#define ACCEL_MG_PER_RAW    3.0625f
+//1 g in normalized counts
+#define ACCEL_ONE_G_RAW     (1000.0f / ACCEL_MG_PER_RAW)
+//400 g range full scale (12.1875 mg per count)
+#define ACCEL_RAW_MAX       130400
+
+struct accel_stats {
+  uint32_t sample_rate_hz;      //samples read over the last second
+  uint32_t samples;
+  uint32_t dropped_samples;     //sensor overruns - a sample was replaced before it was read
+  uint32_t missed_interrupts;   //data ready (or async read completion) wait timed out
+  uint32_t impacts;             //bursts of samples rejected as hits
+  uint32_t rejected_samples;    //samples kept away from the rpm estimator
+  uint32_t saturated_samples;   //X axis at the end of the current range
+  uint32_t range_switches;
+  uint32_t range_g;             //current full scale (100 / 200 / 400)
+  uint32_t bus_transactions;    //bus reads / writes by the direct backend (blocking sample reads included) - 0 through the sensor API
+};
+
+//X axis from the rpm estimator, extrapolated to the middle of the current sample
+//period - latency compensated value for the control path
 float get_accel_g();
+//same in normalized raw counts
+int32_t get_accel_raw();
+//spin up (positive for the sensor's +Y direction) / spin down rate from tangential acceleration
+float get_spin_rate_rpm_s(void);
+//rotation speed implied by centripetal accel (normalized counts) at radius_raw (cm * 1000)
+float accel_raw_to_rad_per_s(int32_t accel_raw, uint16_t radius_raw);
+//latest unfiltered sample with its timestamp and sequence number
+void get_accel_sample(struct sensor_sample *sample);
 void init_accel();
-void update_accel_value();
+//blocks until the next sample has been read and published (or data ready times out)
+//returns false if nothing new was published
+bool wait_accel_sample(void);
+void get_accel_stats(struct accel_stats *stats);
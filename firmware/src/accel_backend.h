@@ -0,0 +1,52 @@
+#ifndef ACCEL_BACKEND_H_
+
+#define ACCEL_BACKEND_H_
+
+#include <zephyr/types.h>
+
+//Accelerometer hardware behind accel.c (implementation picked with MELTY_ACCEL_BACKEND)
+//Both drive the H3LIS331DL on the "st,h3lis331dl" devicetree node - bus, address and
+//the INT1 data ready pin (irq-gpios) all come from there:
+//  accel_backend_h3lis331dl.c - ST register driver straight on the bus, reads can be
+//    started from the data ready interrupt and finish in the bus completion callback
+//  accel_backend_sensor.c - Zephyr sensor API (drivers/sensor/h3lis331dl), so the same
+//    sampling path runs on any board with the driver - or against its i2c emulator
+
+struct accel_backend_sample {
+	int32_t x;					//normalized raw counts (see accel.h)
+	int32_t y;
+	int32_t z;
+	bool saturated;				//X at the end of the range it was read on - real value is larger
+	bool overrun;				//sensor replaced a sample that was never read
+};
+
+//data ready - interrupt context
+typedef void (*accel_backend_ready_cb)(u_int32_t timestamp_cycles);
+
+//async read finished - interrupt context, sample only valid if result is 1
+//timestamp_cycles is whatever the read was started with
+typedef void (*accel_backend_read_cb)(int result, const struct accel_backend_sample *sample,
+				      u_int32_t timestamp_cycles);
+
+//ranges accel_backend_set_range() accepts, smallest first
+extern const u_int32_t accel_backend_ranges_g[];
+extern const int accel_backend_range_count;
+
+//configures the sensor and arms data ready - ready is called for every new sample
+int accel_backend_init(u_int32_t odr_hz, u_int32_t range_g, accel_backend_ready_cb ready);
+
+//1 - new sample read, 0 - nothing new since the last read, negative - bus error
+int accel_backend_read(struct accel_backend_sample *sample);
+
+//starts a read that doesn't block - 0 if started, -EBUSY if the previous one is still on
+//the bus (its sample is being replaced - overrun will count it), -ENOTSUP if the backend
+//can only read blocking
+int accel_backend_read_async(u_int32_t timestamp_cycles, accel_backend_read_cb done);
+
+//samples read after this may still have been converted on the old range (see RANGE_SETTLE_SAMPLES)
+int accel_backend_set_range(u_int32_t range_g);
+
+//bus reads / writes done so far (0 if the backend can't see them)
+u_int32_t accel_backend_bus_transactions(void);
+
+#endif
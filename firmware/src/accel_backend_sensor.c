@@ -0,0 +1,105 @@
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+#include <errno.h>
+
+#include "accel_backend.h"
+#include "accel.h"
+#include "h3lis331dl.h"
+
+#define ACCEL_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(st_h3lis331dl)
+
+#if !DT_NODE_EXISTS(ACCEL_NODE)
+#error "No st,h3lis331dl node in the devicetree (see board overlay)"
+#endif
+
+//m/s^2 per normalized count, in sensor_value micro units
+#define MICRO_MS2_PER_RAW		((int64_t)(ACCEL_MG_PER_RAW * SENSOR_G / 1000))
+
+const u_int32_t accel_backend_ranges_g[] = { 100, 200, 400 };
+const int accel_backend_range_count = ARRAY_SIZE(accel_backend_ranges_g);
+
+static const struct device *accel_dev = DEVICE_DT_GET(ACCEL_NODE);
+
+static accel_backend_ready_cb ready_callback;
+
+//timestamp of the data ready edge itself - handler runs later, on the system work queue
+static void accel_drdy_handler(const struct device *dev, struct sensor_trigger *trigger)
+{
+	struct sensor_value drdy_cycles;
+
+	if (sensor_attr_get(dev, SENSOR_CHAN_ACCEL_XYZ, (enum sensor_attribute)H3LIS331DL_ATTR_DRDY_CYCLES,
+			    &drdy_cycles) != 0) {
+		drdy_cycles.val1 = (int32_t)k_cycle_get_32();
+	}
+
+	ready_callback((u_int32_t)drdy_cycles.val1);
+}
+
+static int32_t to_normalized(const struct sensor_value *value)
+{
+	int64_t micro_ms2 = (int64_t)value->val1 * 1000000 + value->val2;
+	return (int32_t)(micro_ms2 / MICRO_MS2_PER_RAW);
+}
+
+int accel_backend_read(struct accel_backend_sample *sample)
+{
+	struct sensor_value accel[3];
+	struct sensor_value status;
+
+	int ret = sensor_sample_fetch(accel_dev);
+	if (ret == -ENODATA) return 0;
+	if (ret != 0) return ret;
+
+	sensor_channel_get(accel_dev, SENSOR_CHAN_ACCEL_XYZ, accel);
+	sensor_channel_get(accel_dev, (enum sensor_channel)H3LIS331DL_CHAN_STATUS, &status);
+
+	sample->x = to_normalized(&accel[0]);
+	sample->y = to_normalized(&accel[1]);
+	sample->z = to_normalized(&accel[2]);
+	sample->saturated = status.val1 & H3LIS331DL_STATUS_X_SATURATED;
+	sample->overrun = status.val1 & H3LIS331DL_STATUS_OVERRUN;
+
+	return 1;
+}
+
+//sensor API reads always block
+int accel_backend_read_async(u_int32_t timestamp_cycles, accel_backend_read_cb done)
+{
+	return -ENOTSUP;
+}
+
+int accel_backend_set_range(u_int32_t range_g)
+{
+	struct sensor_value full_scale;
+
+	sensor_g_to_ms2(range_g, &full_scale);
+	return sensor_attr_set(accel_dev, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_FULL_SCALE, &full_scale);
+}
+
+//bus traffic is inside the driver
+u_int32_t accel_backend_bus_transactions(void)
+{
+	return 0;
+}
+
+int accel_backend_init(u_int32_t odr_hz, u_int32_t range_g, accel_backend_ready_cb ready)
+{
+	struct sensor_value odr = { .val1 = odr_hz, .val2 = 0 };
+	struct sensor_trigger trigger = {
+		.type = SENSOR_TRIG_DATA_READY,
+		.chan = SENSOR_CHAN_ACCEL_XYZ,
+	};
+
+	if (!device_is_ready(accel_dev)) return -ENODEV;
+
+	int ret = sensor_attr_set(accel_dev, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_SAMPLING_FREQUENCY, &odr);
+	if (ret != 0) return ret;
+
+	ret = accel_backend_set_range(range_g);
+	if (ret != 0) return ret;
+
+	ready_callback = ready;
+	return sensor_trigger_set(accel_dev, &trigger, accel_drdy_handler);
+}
@@ -0,0 +1,180 @@
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/settings/settings.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "accel_cal.h"
+#include "accel.h"
+
+#define SETTINGS_SUBTREE		"accel_cal"
+#define SETTINGS_OFFSETS_KEY	"offsets"
+
+//~1 s at 400 Hz - averages sensor noise down to a few mg
+#define CAPTURE_SAMPLES			400
+//sensor noise is ~200 mg rms - much more than that and the bot is being moved
+#define MAX_STILL_RMS_RAW		(0.4f * ACCEL_ONE_G_RAW)
+//well past the sensor's zero g spec - anything bigger is a bot sitting on its side / spinning
+#define MAX_OFFSET_RAW			(3.0f * ACCEL_ONE_G_RAW)
+
+static struct k_spinlock offsets_lock;
+static struct accel_cal_offsets offsets;
+
+static atomic_t state = ATOMIC_INIT(ACCEL_CAL_NONE);
+
+//capture accumulators - sampling thread only
+static int capture_count;
+static int64_t capture_sum[3];
+static int64_t capture_sum2[3];
+
+
+static void set_offsets(const struct accel_cal_offsets *new_offsets)
+{
+	k_spinlock_key_t key = k_spin_lock(&offsets_lock);
+	offsets = *new_offsets;
+	k_spin_unlock(&offsets_lock, key);
+}
+
+void accel_cal_apply(struct accel_ring_sample *sample)
+{
+	k_spinlock_key_t key = k_spin_lock(&offsets_lock);
+	sample->x -= offsets.x;
+	sample->y -= offsets.y;
+	sample->z -= offsets.z;
+	k_spin_unlock(&offsets_lock, key);
+}
+
+//flash writes stay off the sampling thread
+static void save_offsets(struct k_work *work)
+{
+	struct accel_cal_offsets saved;
+	accel_cal_get(&saved);
+
+	int err = settings_save_one(SETTINGS_SUBTREE "/" SETTINGS_OFFSETS_KEY, &saved, sizeof(saved));
+	if (err) printk("Accel calibration save failed (err %d)\n", err);
+}
+
+static void delete_offsets(struct k_work *work)
+{
+	int err = settings_delete(SETTINGS_SUBTREE "/" SETTINGS_OFFSETS_KEY);
+	if (err) printk("Accel calibration delete failed (err %d)\n", err);
+}
+
+static K_WORK_DEFINE(save_work, save_offsets);
+static K_WORK_DEFINE(delete_work, delete_offsets);
+
+static void finish_capture(void)
+{
+	struct accel_cal_offsets residual;
+	int16_t *residual_axis[3] = { &residual.x, &residual.y, &residual.z };
+
+	for (int axis = 0; axis < 3; axis++) {
+		float mean = (float)capture_sum[axis] / CAPTURE_SAMPLES;
+		float variance = (float)capture_sum2[axis] / CAPTURE_SAMPLES - mean * mean;
+
+		if (variance > MAX_STILL_RMS_RAW * MAX_STILL_RMS_RAW) {
+			printk("Accel calibration failed - moving (axis %d rms %d)\n", axis, (int)sqrtf(variance));
+			atomic_set(&state, ACCEL_CAL_FAILED);
+			return;
+		}
+
+		//Z sees gravity - whichever way up the bot is sitting
+		if (axis == 2) mean -= mean >= 0.0f ? ACCEL_ONE_G_RAW : -ACCEL_ONE_G_RAW;
+
+		*residual_axis[axis] = (int16_t)lroundf(mean);
+	}
+
+	//samples were already corrected by the old offsets - what's left is the change
+	struct accel_cal_offsets new_offsets;
+	accel_cal_get(&new_offsets);
+	new_offsets.x += residual.x;
+	new_offsets.y += residual.y;
+	new_offsets.z += residual.z;
+
+	if (abs(new_offsets.x) > MAX_OFFSET_RAW || abs(new_offsets.y) > MAX_OFFSET_RAW ||
+	    abs(new_offsets.z) > MAX_OFFSET_RAW) {
+		printk("Accel calibration failed - offset out of range (%d, %d, %d)\n",
+		       new_offsets.x, new_offsets.y, new_offsets.z);
+		atomic_set(&state, ACCEL_CAL_FAILED);
+		return;
+	}
+
+	set_offsets(&new_offsets);
+	atomic_set(&state, ACCEL_CAL_VALID);
+	k_work_submit(&save_work);
+
+	printk("Accel calibration offsets %d, %d, %d mg\n", (int)(new_offsets.x * ACCEL_MG_PER_RAW),
+	       (int)(new_offsets.y * ACCEL_MG_PER_RAW), (int)(new_offsets.z * ACCEL_MG_PER_RAW));
+}
+
+void accel_cal_update(const struct accel_ring_sample *sample)
+{
+	if (atomic_get(&state) != ACCEL_CAL_CAPTURING) return;
+
+	int32_t values[3] = { sample->x, sample->y, sample->z };
+
+	if (capture_count == 0) {
+		for (int axis = 0; axis < 3; axis++) {
+			capture_sum[axis] = 0;
+			capture_sum2[axis] = 0;
+		}
+	}
+
+	for (int axis = 0; axis < 3; axis++) {
+		capture_sum[axis] += values[axis];
+		capture_sum2[axis] += (int64_t)values[axis] * values[axis];
+	}
+
+	if (++capture_count < CAPTURE_SAMPLES) return;
+
+	capture_count = 0;
+	finish_capture();
+}
+
+int accel_cal_start(void)
+{
+	if (atomic_get(&state) == ACCEL_CAL_CAPTURING) return -EBUSY;
+
+	capture_count = 0;
+	atomic_set(&state, ACCEL_CAL_CAPTURING);
+	return 0;
+}
+
+void accel_cal_clear(void)
+{
+	struct accel_cal_offsets zero = { 0, 0, 0 };
+
+	set_offsets(&zero);
+	atomic_set(&state, ACCEL_CAL_NONE);
+	k_work_submit(&delete_work);
+}
+
+enum accel_cal_state accel_cal_get(struct accel_cal_offsets *offsets_out)
+{
+	k_spinlock_key_t key = k_spin_lock(&offsets_lock);
+	*offsets_out = offsets;
+	k_spin_unlock(&offsets_lock, key);
+
+	return atomic_get(&state);
+}
+
+static int accel_cal_settings_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	const char *next;
+
+	if (!settings_name_steq(name, SETTINGS_OFFSETS_KEY, &next) || next) return -ENOENT;
+	if (len != sizeof(struct accel_cal_offsets)) return -EINVAL;
+
+	struct accel_cal_offsets loaded;
+	ssize_t read_len = read_cb(cb_arg, &loaded, sizeof(loaded));
+	if (read_len != sizeof(loaded)) return read_len < 0 ? read_len : -EINVAL;
+
+	set_offsets(&loaded);
+	atomic_set(&state, ACCEL_CAL_VALID);
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(accel_cal, SETTINGS_SUBTREE, NULL, accel_cal_settings_set, NULL, NULL);
@@ -0,0 +1,41 @@
+#ifndef ACCEL_CAL_H_
+
+#define ACCEL_CAL_H_
+
+#include <zephyr/types.h>
+
+#include "accel_ring.h"
+
+//Zero g offset calibration for all three accelerometer axes
+//Captured on request while the bot sits still (X / Y read 0 g, Z reads 1 g either side up),
+//kept in settings so it's there as soon as settings_load() runs - no sampling at startup
+
+enum accel_cal_state {
+	ACCEL_CAL_NONE,				//no offsets - samples used as read
+	ACCEL_CAL_CAPTURING,
+	ACCEL_CAL_VALID,
+	ACCEL_CAL_FAILED,			//bot moved (or offsets out of range) during the last capture - previous offsets kept
+};
+
+//normalized raw counts (see accel.h) subtracted from every sample
+struct accel_cal_offsets {
+	int16_t x;
+	int16_t y;
+	int16_t z;
+};
+
+//subtracts the offsets from a decoded sample - any context (async reads decode in the bus interrupt)
+void accel_cal_apply(struct accel_ring_sample *sample);
+
+//sampling thread - feeds corrected samples to a capture in progress
+void accel_cal_update(const struct accel_ring_sample *sample);
+
+//starts a capture on the next samples - -EBUSY if one is already running
+int accel_cal_start(void);
+
+//drops the offsets and the stored copy
+void accel_cal_clear(void);
+
+enum accel_cal_state accel_cal_get(struct accel_cal_offsets *offsets);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef ACCEL_RING_H_
+
+#define ACCEL_RING_H_
+
+#include <zephyr/types.h>
+#include <zephyr/sys/atomic.h>
+
+//Lock free single producer / single consumer ring of timestamped raw accel samples
+//Producer is whatever decodes samples (read completion callback or sampling thread),
+//consumer is the sampling thread building the latency compensated estimate
+
+//must be a power of 2
+#define ACCEL_RING_SIZE		32
+
+struct accel_ring_sample {
+	u_int32_t timestamp_cycles;		//k_cycle_get_32() at data ready
+	int32_t x;						//normalized raw counts (see accel.h)
+	int32_t y;
+	int32_t z;
+	bool saturated;					//X at the end of the range it was read on - real value is larger
+};
+
+struct accel_ring {
+	atomic_t head;					//only written by producer
+	atomic_t tail;					//only written by consumer
+	u_int32_t dropped;				//samples lost to a full ring
+	struct accel_ring_sample samples[ACCEL_RING_SIZE];
+};
+
+static inline bool accel_ring_put(struct accel_ring *ring, const struct accel_ring_sample *sample)
+{
+	u_int32_t head = (u_int32_t)atomic_get(&ring->head);
+
+	if (head - (u_int32_t)atomic_get(&ring->tail) >= ACCEL_RING_SIZE) {
+		ring->dropped++;
+		return false;
+	}
+
+	ring->samples[head & (ACCEL_RING_SIZE - 1)] = *sample;
+
+	//slot has to be filled before the consumer can see it
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	atomic_set(&ring->head, head + 1);
+
+	return true;
+}
+
+static inline bool accel_ring_get(struct accel_ring *ring, struct accel_ring_sample *sample)
+{
+	u_int32_t tail = (u_int32_t)atomic_get(&ring->tail);
+
+	if (tail == (u_int32_t)atomic_get(&ring->head)) return false;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	*sample = ring->samples[tail & (ACCEL_RING_SIZE - 1)];
+
+	//slot has to be copied out before the producer can reuse it
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	atomic_set(&ring->tail, tail + 1);
+
+	return true;
+}
+
+#endif
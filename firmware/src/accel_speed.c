@@ -0,0 +1,14 @@
+#include <zephyr/types.h>
+#include <math.h>
+
+#include "accel.h"
+
+//m/s^2 per normalized count
+#define MS2_PER_RAW           (ACCEL_MG_PER_RAW * 9.80665f / 1000.0f)
+
+//w = sqrt(a / r)
+float accel_raw_to_rad_per_s(int32_t accel_raw, uint16_t radius_raw)
+{
+  if (radius_raw == 0 || accel_raw <= 0) return 0.0f;
+  return sqrtf(accel_raw * MS2_PER_RAW / (radius_raw / 100000.0f));
+}
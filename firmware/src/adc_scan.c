@@ -0,0 +1,188 @@
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <errno.h>
+
+#include <nrfx_saadc.h>
+#include <nrfx_timer.h>
+#include <nrfx_ppi.h>
+#include <hal/nrf_saadc.h>
+
+#include "adc_scan.h"
+
+//TIMER0 is reserved by MPSL / SoftDevice Controller, TIMER3 + TIMER4 drive the motor edges
+#define SCAN_TIMER_INSTANCE		2
+
+//nothing here is time critical - stay well below the radio and motor timer
+#define SAADC_IRQ_PRIORITY		5
+
+//scans averaged per result - at 200 Hz that is a result per channel every 100 ms
+#define SCANS_PER_BUFFER		20
+
+//conversions the SAADC averages itself for each channel in a scan
+#define OVERSAMPLE				NRF_SAADC_OVERSAMPLE_16X
+
+//doc says that impedance of 800K == 40usec sample time
+#define ACQUISITION_TIME		NRF_SAADC_ACQTIME_40US
+//pins driven by an output - 16x oversampled these take 80 us instead of 670 us
+#define DRIVEN_ACQUISITION_TIME	NRF_SAADC_ACQTIME_3US
+
+//gain 1/6 against the 0.6 V internal reference - 3.6 V full scale
+#define RESOLUTION				NRF_SAADC_RESOLUTION_12BIT
+#define VOLTS_PER_COUNT			(3.6f / 4096.0f)
+
+static const nrfx_timer_t scan_timer = NRFX_TIMER_INSTANCE(SCAN_TIMER_INSTANCE);
+
+static nrfx_saadc_channel_t channels[ADC_SCAN_MAX_CHANNELS];
+static adc_scan_handler_t handlers[ADC_SCAN_MAX_CHANNELS];
+static int channel_count = 0;
+static adc_scan_scan_handler_t scan_handler = NULL;
+
+//EasyDMA fills one while the other is averaged - results interleaved by channel index
+static nrf_saadc_value_t buffers[2][SCANS_PER_BUFFER * ADC_SCAN_MAX_CHANNELS];
+static int next_buffer = 0;
+
+static u_int32_t irq_count = 0;
+static bool started = false;
+
+
+static void average_buffer(const nrf_saadc_value_t *buffer, u_int16_t size)
+{
+	int scans = size / channel_count;
+
+	if (scan_handler) {
+		float volts[ADC_SCAN_MAX_CHANNELS];
+
+		for (int scan = 0; scan < scans; scan++) {
+			for (int channel = 0; channel < channel_count; channel++) {
+				volts[channel] = buffer[scan * channel_count + channel] * VOLTS_PER_COUNT;
+			}
+			scan_handler(volts);
+		}
+	}
+
+	for (int channel = 0; channel < channel_count; channel++) {
+		int32_t sum = 0;
+
+		if (!handlers[channel]) continue;
+
+		for (int scan = 0; scan < scans; scan++) {
+			sum += buffer[scan * channel_count + channel];
+		}
+
+		handlers[channel]((float)sum / scans * VOLTS_PER_COUNT);
+	}
+}
+
+static void saadc_handler(nrfx_saadc_evt_t const *event)
+{
+	switch (event->type) {
+	case NRFX_SAADC_EVT_BUF_REQ:
+		//current buffer has started - line up the other one behind it (START follows END in hardware)
+		nrfx_saadc_buffer_set(buffers[next_buffer], SCANS_PER_BUFFER * channel_count);
+		next_buffer ^= 1;
+		break;
+	case NRFX_SAADC_EVT_DONE:
+		average_buffer(event->data.done.p_buffer, event->data.done.size);
+		break;
+	default:
+		break;
+	}
+}
+
+static void saadc_isr(const void *arg)
+{
+	irq_count++;
+	nrfx_saadc_irq_handler();
+}
+
+//compare event only feeds PPI - no timer interrupts are enabled
+static void scan_timer_handler(nrf_timer_event_t event_type, void *context)
+{
+}
+
+static int add_channel(u_int8_t ain, nrf_saadc_acqtime_t acq_time, adc_scan_handler_t handler)
+{
+	if (started) return -EBUSY;
+	if (channel_count >= ADC_SCAN_MAX_CHANNELS || ain > 7) return -EINVAL;
+
+	nrfx_saadc_channel_t channel = NRFX_SAADC_DEFAULT_CHANNEL_SE(NRF_SAADC_INPUT_AIN0 + ain, channel_count);
+	channel.channel_config.acq_time = acq_time;
+
+	channels[channel_count] = channel;
+	handlers[channel_count] = handler;
+
+	return channel_count++;
+}
+
+int adc_scan_channel_add(u_int8_t ain, adc_scan_handler_t handler)
+{
+	return add_channel(ain, ACQUISITION_TIME, handler);
+}
+
+int adc_scan_channel_add_driven(u_int8_t ain)
+{
+	return add_channel(ain, DRIVEN_ACQUISITION_TIME, NULL);
+}
+
+void adc_scan_set_scan_handler(adc_scan_scan_handler_t handler)
+{
+	scan_handler = handler;
+}
+
+int adc_scan_start(void)
+{
+	nrfx_saadc_adv_config_t adv_config = NRFX_SAADC_DEFAULT_ADV_CONFIG;
+	nrfx_timer_config_t timer_config = NRFX_TIMER_DEFAULT_CONFIG;
+	nrf_ppi_channel_t ppi_channel;
+	u_int32_t channel_mask = 0;
+
+	if (started) return -EALREADY;
+	if (channel_count == 0) return -EINVAL;
+
+	IRQ_CONNECT(DT_IRQN(DT_NODELABEL(adc)), SAADC_IRQ_PRIORITY, saadc_isr, NULL, 0);
+
+	if (nrfx_saadc_init(SAADC_IRQ_PRIORITY) != NRFX_SUCCESS) return -EIO;
+	if (nrfx_saadc_channels_config(channels, channel_count) != NRFX_SUCCESS) return -EIO;
+
+	//blocking - only once at start
+	if (nrfx_saadc_offset_calibrate(NULL) != NRFX_SUCCESS) return -EIO;
+
+	for (int x = 0; x < channel_count; x++) channel_mask |= BIT(x);
+
+	//scan mode only oversamples per channel with burst on
+	adv_config.oversampling = OVERSAMPLE;
+	adv_config.burst = NRF_SAADC_BURST_ENABLED;
+	adv_config.internal_timer_cc = 0;
+	adv_config.start_on_end = true;
+
+	if (nrfx_saadc_advanced_mode_set(channel_mask, RESOLUTION, &adv_config, saadc_handler) != NRFX_SUCCESS) {
+		return -EIO;
+	}
+
+	nrfx_saadc_buffer_set(buffers[0], SCANS_PER_BUFFER * channel_count);
+	next_buffer = 1;
+
+	timer_config.frequency = NRF_TIMER_FREQ_1MHz;
+	timer_config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+	if (nrfx_timer_init(&scan_timer, &timer_config, scan_timer_handler) != NRFX_SUCCESS) return -EIO;
+
+	nrfx_timer_extended_compare(&scan_timer, NRF_TIMER_CC_CHANNEL0, 1000000 / CONFIG_MELTY_ADC_SCAN_RATE_HZ,
+				    NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, false);
+
+	if (nrfx_ppi_channel_alloc(&ppi_channel) != NRFX_SUCCESS) return -EBUSY;
+	nrfx_ppi_channel_assign(ppi_channel, nrfx_timer_compare_event_address_get(&scan_timer, NRF_TIMER_CC_CHANNEL0),
+				nrf_saadc_task_address_get(NRF_SAADC, NRF_SAADC_TASK_SAMPLE));
+	nrfx_ppi_channel_enable(ppi_channel);
+
+	//START now - every SAMPLE after this comes from the timer
+	if (nrfx_saadc_mode_trigger() != NRFX_SUCCESS) return -EIO;
+	nrfx_timer_enable(&scan_timer);
+
+	started = true;
+	return 0;
+}
+
+u_int32_t adc_scan_get_irq_count(void)
+{
+	return irq_count;
+}
@@ -0,0 +1,36 @@
+#ifndef ADC_SCAN_H_
+
+#define ADC_SCAN_H_
+
+#include <zephyr/types.h>
+
+//Continuous SAADC scan
+//TIMER2 triggers SAMPLE through PPI at CONFIG_MELTY_ADC_SCAN_RATE_HZ, each sample converts
+//every added channel in turn (burst - oversampled in hardware), EasyDMA fills one buffer
+//while the other is averaged in the SAADC interrupt. No thread, one interrupt pair per buffer
+
+#define ADC_SCAN_MAX_CHANNELS		8
+
+//averaged input voltage (at the pin) - SAADC interrupt context
+typedef void (*adc_scan_handler_t)(float volts);
+
+//every scan of a buffer (input voltage per channel index) - SAADC interrupt context,
+//all scans of a buffer are handed over before its averaged handlers run
+typedef void (*adc_scan_scan_handler_t)(const float *volts);
+
+//before adc_scan_start() - ain is the analog input number (AIN0..7)
+//returns the channel index (scan order) or a negative error, handler may be NULL
+int adc_scan_channel_add(u_int8_t ain, adc_scan_handler_t handler);
+
+//same for a pin driven by a low impedance source (e.g. a GPIO output) - short
+//acquisition, results only through the scan handler. The same pin may be added more than once
+int adc_scan_channel_add_driven(u_int8_t ain);
+
+void adc_scan_set_scan_handler(adc_scan_scan_handler_t handler);
+
+int adc_scan_start(void);
+
+//SAADC interrupts taken so far
+u_int32_t adc_scan_get_irq_count(void);
+
+#endif
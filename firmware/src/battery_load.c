@@ -0,0 +1,206 @@
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <errno.h>
+
+#include "battery_load.h"
+#include "adc_scan.h"
+
+//motor drive pins are analog capable - P0.04 = AIN2 (MOTOR_PIN1), P0.03 = AIN1 (MOTOR_PIN2)
+#define MOTOR1_SENSE_AIN		2
+#define MOTOR2_SENSE_AIN		1
+#define MOTOR_COUNT				2
+
+//drive pin levels against the 3.6 V full scale - in between means it switched during the conversion
+#define SENSE_HIGH_V			2.0f
+#define SENSE_LOW_V				0.5f
+
+//weight of older scans per buffer (100 ms) - same 0.8 as the battery voltage filter
+#define HISTORY_DECAY			0.8f
+
+//a buffer with fewer scans of a kind leaves that voltage as it was
+#define MIN_SCANS				2
+
+//motors on has to have varied this much (variance) in the history before slope and intercept can be told apart
+#define MIN_MOTOR_VARIANCE		0.02f
+
+//least squares sums of battery voltage (v) against motors on (n)
+struct fit_sums {
+	float weight;
+	float n;
+	float v;
+	float nn;
+	float nv;
+};
+
+static int sense_before[MOTOR_COUNT];
+static int sense_after[MOTOR_COUNT];
+static int battery_channel;
+static adc_scan_handler_t averaged_handler;
+static float divider;
+
+//everything below is only touched in the SAADC interrupt
+static struct fit_sums buffer_sums;
+static struct fit_sums history;
+static float loaded_sum;
+static int loaded_scans;
+static float unloaded_sum;
+static int unloaded_scans;
+static float loaded_voltage = 0.0f;
+static float unloaded_voltage = 0.0f;
+
+static struct sensor_publication loaded_publication;
+static struct sensor_publication unloaded_publication;
+static struct sensor_publication open_circuit_publication;
+static struct sensor_publication sag_publication;
+static struct sensor_publication resistance_publication;
+
+
+//motors driven during the conversions - -1 if a pin was switching
+static int motors_on(const float *volts, const int *sense)
+{
+	int on = 0;
+
+	for (int x = 0; x < MOTOR_COUNT; x++) {
+		float level = volts[sense[x]];
+
+		if (level > SENSE_HIGH_V) {
+			on++;
+		} else if (level >= SENSE_LOW_V) {
+			return -1;
+		}
+	}
+
+	return on;
+}
+
+static void scan_handler(const float *volts)
+{
+	int before = motors_on(volts, sense_before);
+	int after = motors_on(volts, sense_after);
+
+	//load changed somewhere across the battery conversion
+	if (before < 0 || before != after) return;
+
+	float v = volts[battery_channel] * divider;
+	float n = before;
+
+	buffer_sums.weight += 1.0f;
+	buffer_sums.n += n;
+	buffer_sums.v += v;
+	buffer_sums.nn += n * n;
+	buffer_sums.nv += n * v;
+
+	if (before > 0) {
+		loaded_sum += v;
+		loaded_scans++;
+	} else {
+		unloaded_sum += v;
+		unloaded_scans++;
+	}
+}
+
+static void filter_and_publish(struct sensor_publication *publication, float *filtered, float value)
+{
+	if (*filtered == 0) *filtered = value;
+	*filtered = (*filtered * 0.8f) + (value * 0.2f);
+
+	//raw is in mV
+	sensor_publish(publication, *filtered, (int32_t)(*filtered * 1000.0f));
+}
+
+static void update_fit(void)
+{
+	history.weight = history.weight * HISTORY_DECAY + buffer_sums.weight;
+	history.n = history.n * HISTORY_DECAY + buffer_sums.n;
+	history.v = history.v * HISTORY_DECAY + buffer_sums.v;
+	history.nn = history.nn * HISTORY_DECAY + buffer_sums.nn;
+	history.nv = history.nv * HISTORY_DECAY + buffer_sums.nv;
+	buffer_sums = (struct fit_sums){ 0 };
+
+	if (history.weight < MIN_SCANS) return;
+
+	float mean_n = history.n / history.weight;
+	float mean_v = history.v / history.weight;
+	float variance_n = history.nn / history.weight - mean_n * mean_n;
+
+	if (variance_n < MIN_MOTOR_VARIANCE) {
+		//motors off the whole time - nothing drawn, what we see is open circuit
+		if (mean_n < 0.5f) sensor_publish(&open_circuit_publication, mean_v, (int32_t)(mean_v * 1000.0f));
+		return;
+	}
+
+	float slope = (history.nv / history.weight - mean_n * mean_v) / variance_n;
+	float open_circuit = mean_v - slope * mean_n;
+
+	sensor_publish(&open_circuit_publication, open_circuit, (int32_t)(open_circuit * 1000.0f));
+	sensor_publish(&sag_publication, -slope, (int32_t)(-slope * 1000.0f));
+
+	if (CONFIG_MELTY_MOTOR_CURRENT_MA > 0) {
+		float resistance = -slope / (CONFIG_MELTY_MOTOR_CURRENT_MA / 1000.0f);
+
+		//raw is in mOhm
+		sensor_publish(&resistance_publication, resistance, (int32_t)(resistance * 1000.0f));
+	}
+}
+
+//runs after every scan of the buffer went through scan_handler
+static void battery_buffer_done(float volts)
+{
+	if (loaded_scans >= MIN_SCANS) {
+		filter_and_publish(&loaded_publication, &loaded_voltage, loaded_sum / loaded_scans);
+	}
+	if (unloaded_scans >= MIN_SCANS) {
+		filter_and_publish(&unloaded_publication, &unloaded_voltage, unloaded_sum / unloaded_scans);
+	}
+
+	loaded_sum = 0.0f;
+	loaded_scans = 0;
+	unloaded_sum = 0.0f;
+	unloaded_scans = 0;
+
+	update_fit();
+
+	averaged_handler(volts);
+}
+
+static int add_sense_channels(int *channels)
+{
+	channels[0] = adc_scan_channel_add_driven(MOTOR1_SENSE_AIN);
+	if (channels[0] < 0) return channels[0];
+
+	channels[1] = adc_scan_channel_add_driven(MOTOR2_SENSE_AIN);
+	if (channels[1] < 0) return channels[1];
+
+	return 0;
+}
+
+int battery_load_init(u_int8_t battery_ain, adc_scan_handler_t battery_handler, float divider_ratio)
+{
+	int ret;
+
+	averaged_handler = battery_handler;
+	divider = divider_ratio;
+
+	//scan order is add order - the battery conversion is bracketed by the drive pin levels
+	ret = add_sense_channels(sense_before);
+	if (ret < 0) return ret;
+
+	battery_channel = adc_scan_channel_add(battery_ain, battery_buffer_done);
+	if (battery_channel < 0) return battery_channel;
+
+	ret = add_sense_channels(sense_after);
+	if (ret < 0) return ret;
+
+	adc_scan_set_scan_handler(scan_handler);
+
+	return battery_channel;
+}
+
+void get_battery_load_stats(struct battery_load_stats *stats)
+{
+	sensor_read(&loaded_publication, &stats->loaded);
+	sensor_read(&unloaded_publication, &stats->unloaded);
+	sensor_read(&open_circuit_publication, &stats->open_circuit);
+	sensor_read(&sag_publication, &stats->sag_per_motor);
+	sensor_read(&resistance_publication, &stats->internal_resistance);
+}
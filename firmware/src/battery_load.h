@@ -0,0 +1,42 @@
+#ifndef BATTERY_LOAD_H_
+
+#define BATTERY_LOAD_H_
+
+#include <zephyr/types.h>
+
+#include "sensor_publish.h"
+#include "adc_scan.h"
+
+//Load synchronous battery measurement
+//The motor drive pins are sampled in the same SAADC scan as the battery, either side of it, so
+//every scan is known to be loaded (a motor on throughout), unloaded (both off throughout) or
+//switching (discarded). Battery voltage against motors on is fitted with a decaying least squares
+//line: intercept = open circuit voltage, slope = sag per motor (/ motor current = internal resistance)
+
+struct battery_load_stats {
+	struct sensor_sample loaded;				//raw in mV
+	struct sensor_sample unloaded;				//raw in mV
+	struct sensor_sample open_circuit;			//raw in mV
+	struct sensor_sample sag_per_motor;			//volts dropped per motor switched on, raw in mV
+	struct sensor_sample internal_resistance;	//ohms, raw in mOhm - needs CONFIG_MELTY_MOTOR_CURRENT_MA
+};
+
+#if defined(CONFIG_MELTY_BATTERY_LOAD_SYNC)
+
+//adds the battery channel with the motor sense channels either side of it - before adc_scan_start()
+//battery_handler still gets every averaged buffer, divider_ratio scales the pin voltage to the pack
+int battery_load_init(u_int8_t battery_ain, adc_scan_handler_t battery_handler, float divider_ratio);
+
+//sequence 0 = nothing measured yet
+void get_battery_load_stats(struct battery_load_stats *stats);
+
+#else
+
+static inline void get_battery_load_stats(struct battery_load_stats *stats)
+{
+	*stats = (struct battery_load_stats){ 0 };
+}
+
+#endif
+
+#endif
@@ -0,0 +1,305 @@
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include <zephyr/logging/log.h>
+
+#include "conn_params.h"
+#include "melty_ble.h"
+
+LOG_MODULE_REGISTER(conn_params, 3);
+
+//central is busy with discovery / MTU exchange right after connecting - give it a moment first
+#define CONNECT_SETTLE_MS		200
+
+//longest LL payload our own controller will take - asking for more than that can never be granted
+#if defined(CONFIG_BT_CTLR_DATA_LENGTH_MAX)
+#define LOCAL_DATA_LEN_MAX		CONFIG_BT_CTLR_DATA_LENGTH_MAX
+#else
+#define LOCAL_DATA_LEN_MAX		BT_GAP_DATA_LEN_MAX
+#endif
+//time on air of that payload at 1M PHY - 14 octets of preamble, access address, header and CRC
+#define LOCAL_DATA_TIME_MAX		((LOCAL_DATA_LEN_MAX + 14) * 8)
+
+static struct k_spinlock link_lock;
+static struct conn_link link;
+static struct bt_conn *link_conn;
+
+static void report_link(struct k_work *work);
+
+static K_WORK_DEFINE(report_work, report_link);
+
+#if defined(CONFIG_MELTY_CONN_NEGOTIATION)
+
+//interval and latency only go out with the supervision timeout sized for them
+BUILD_ASSERT(CONFIG_MELTY_CONN_TIMEOUT * 10 > CONFIG_MELTY_CONN_INTERVAL * 5 / 4 * 2,
+	     "supervision timeout too short for the control interval");
+
+#if defined(CONFIG_MELTY_CONN_POWER_SAVE)
+//worst case a control write waits for the central to reach the bot - keep it well inside the failsafe
+#define IDLE_EVENT_SPACING_MS	(CONFIG_MELTY_CONN_IDLE_INTERVAL * 5 / 4 * (CONFIG_MELTY_CONN_IDLE_LATENCY + 1))
+
+BUILD_ASSERT(IDLE_EVENT_SPACING_MS * 2 <= CONFIG_MELTY_CONTROL_TIMEOUT_MS,
+	     "power save interval / latency would trip the control failsafe");
+BUILD_ASSERT(CONFIG_MELTY_CONN_TIMEOUT * 10 > IDLE_EVENT_SPACING_MS * 2,
+	     "supervision timeout too short for the power save interval");
+#endif
+
+static atomic_t power_save;
+
+//per connection, reset when the wanted interval changes - only touched by negotiate()
+static u_int8_t param_attempts;
+static u_int8_t phy_attempts;
+static u_int8_t data_len_attempts;
+
+//a request went out on the last pass and hasn't been judged yet - each one is counted as refused
+//at most once, however many passes run after retries are used up
+static bool param_requested;
+static bool phy_requested;
+static bool data_len_requested;
+
+//counters to clear before the next negotiate() pass - set from the BT RX thread
+#define RESET_PARAM_ATTEMPTS	BIT(0)
+#define RESET_PHY_ATTEMPTS		BIT(1)		//PHY and data length
+
+static atomic_t reset_attempts;
+
+static void negotiate(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(negotiate_work, negotiate);
+
+static const struct bt_le_conn_param *wanted_params(void)
+{
+#if defined(CONFIG_MELTY_CONN_POWER_SAVE)
+	if (atomic_get(&power_save)) {
+		return BT_LE_CONN_PARAM(CONFIG_MELTY_CONN_IDLE_INTERVAL, CONFIG_MELTY_CONN_IDLE_INTERVAL,
+					CONFIG_MELTY_CONN_IDLE_LATENCY, CONFIG_MELTY_CONN_TIMEOUT);
+	}
+#endif
+	return BT_LE_CONN_PARAM(CONFIG_MELTY_CONN_INTERVAL, CONFIG_MELTY_CONN_INTERVAL,
+				0, CONFIG_MELTY_CONN_TIMEOUT);
+}
+
+static void count_refusal(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&link_lock);
+	if (link.refusals < UINT8_MAX) link.refusals++;
+	k_spin_unlock(&link_lock, key);
+
+	k_work_submit(&report_work);
+}
+
+//system workqueue - asks for whatever the connection doesn't have yet, then checks back
+static void negotiate(struct k_work *work)
+{
+	const struct bt_le_conn_param *param = wanted_params();
+	struct bt_conn_info info;
+	struct bt_conn *conn;
+	u_int8_t attempts = 0;
+
+	//a request for parameters no longer wanted isn't refused by not being granted
+	atomic_val_t reset = atomic_clear(&reset_attempts);
+	if (reset & RESET_PARAM_ATTEMPTS) {
+		param_attempts = 0;
+		param_requested = false;
+	}
+	if (reset & RESET_PHY_ATTEMPTS) {
+		phy_attempts = 0;
+		data_len_attempts = 0;
+		phy_requested = false;
+		data_len_requested = false;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&link_lock);
+	conn = link_conn ? bt_conn_ref(link_conn) : NULL;
+	k_spin_unlock(&link_lock, key);
+
+	if (!conn) return;
+
+	if (bt_conn_get_info(conn, &info) != 0) {
+		bt_conn_unref(conn);
+		return;
+	}
+
+	bool param_wanted = info.le.interval < param->interval_min || info.le.interval > param->interval_max ||
+			    info.le.latency != param->latency;
+	bool phy_wanted = info.le.phy->tx_phy != BT_GAP_LE_PHY_2M || info.le.phy->rx_phy != BT_GAP_LE_PHY_2M;
+	bool data_len_wanted = info.le.data_len->tx_max_len < LOCAL_DATA_LEN_MAX;
+
+	//the request sent last pass went unanswered (or was answered with something else)
+	if (param_requested && param_wanted) count_refusal();
+	if (phy_requested && phy_wanted) count_refusal();
+	if (data_len_requested && data_len_wanted) count_refusal();
+
+	param_requested = param_wanted && param_attempts < CONFIG_MELTY_CONN_RETRIES + 1;
+	phy_requested = phy_wanted && phy_attempts < CONFIG_MELTY_CONN_RETRIES + 1;
+	data_len_requested = data_len_wanted && data_len_attempts < CONFIG_MELTY_CONN_RETRIES + 1;
+
+	if (param_requested) {
+		LOG_DBG("Requesting interval %u latency %u (have %u / %u)", param->interval_min,
+			param->latency, info.le.interval, info.le.latency);
+		bt_conn_le_param_update(conn, param);
+		attempts = MAX(attempts, ++param_attempts);
+	}
+
+	if (phy_requested) {
+		bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+		attempts = MAX(attempts, ++phy_attempts);
+	}
+
+	if (data_len_requested) {
+		bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM(LOCAL_DATA_LEN_MAX, LOCAL_DATA_TIME_MAX));
+		attempts = MAX(attempts, ++data_len_attempts);
+	}
+
+	//check back later - backing off so a central that keeps saying no isn't hammered
+	if (attempts > 0) {
+		k_work_reschedule(&negotiate_work, K_MSEC(CONFIG_MELTY_CONN_RETRY_MS << (attempts - 1)));
+	}
+
+	bt_conn_unref(conn);
+}
+
+void conn_params_set_throttle(u_int8_t throttle)
+{
+#if defined(CONFIG_MELTY_CONN_POWER_SAVE)
+	bool idle = (throttle == 0);
+
+	if (atomic_set(&power_save, idle) == idle) return;
+
+	atomic_or(&reset_attempts, RESET_PARAM_ATTEMPTS);
+
+	k_spinlock_key_t key = k_spin_lock(&link_lock);
+	link.mode = idle ? CONN_MODE_POWER_SAVE : CONN_MODE_CONTROL;
+	k_spin_unlock(&link_lock, key);
+
+	//back to control straight away, only drop to power save once throttle has stayed at 0
+	k_work_reschedule(&negotiate_work, idle ? K_MSEC(CONFIG_MELTY_CONN_IDLE_DELAY_MS) : K_NO_WAIT);
+#endif
+}
+
+#else
+
+void conn_params_set_throttle(u_int8_t throttle)
+{
+}
+
+#endif
+
+static void report_link(struct k_work *work)
+{
+	bt_send_melty_link();
+}
+
+void get_conn_link(struct conn_link *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&link_lock);
+	*out = link;
+	k_spin_unlock(&link_lock, key);
+}
+
+static void link_connected(struct bt_conn *conn, uint8_t err)
+{
+	struct bt_conn_info info;
+
+	if (err) return;
+	if (bt_conn_get_info(conn, &info) != 0) return;
+
+	k_spinlock_key_t key = k_spin_lock(&link_lock);
+	link = (struct conn_link){
+		.interval = info.le.interval,
+		.latency = info.le.latency,
+		.timeout = info.le.timeout,
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+		.tx_phy = info.le.phy->tx_phy,
+		.rx_phy = info.le.phy->rx_phy,
+#endif
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+		.tx_len = info.le.data_len->tx_max_len,
+		.rx_len = info.le.data_len->rx_max_len,
+#endif
+	};
+	link_conn = bt_conn_ref(conn);
+	k_spin_unlock(&link_lock, key);
+
+#if defined(CONFIG_MELTY_CONN_NEGOTIATION)
+	//a fresh connection is about to be driven - start out in control mode
+	atomic_set(&power_save, 0);
+	atomic_or(&reset_attempts, RESET_PARAM_ATTEMPTS | RESET_PHY_ATTEMPTS);
+
+	k_work_reschedule(&negotiate_work, K_MSEC(CONNECT_SETTLE_MS));
+#endif
+}
+
+static void link_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+#if defined(CONFIG_MELTY_CONN_NEGOTIATION)
+	k_work_cancel_delayable(&negotiate_work);
+#endif
+
+	k_spinlock_key_t key = k_spin_lock(&link_lock);
+	if (link_conn) {
+		bt_conn_unref(link_conn);
+		link_conn = NULL;
+	}
+	link = (struct conn_link){ 0 };
+	k_spin_unlock(&link_lock, key);
+}
+
+static void link_le_param_updated(struct bt_conn *conn, uint16_t interval,
+				  uint16_t latency, uint16_t timeout)
+{
+	LOG_INF("Connection interval %u.%02u ms latency %u timeout %u ms", interval * 5 / 4,
+		interval * 125 % 100, latency, timeout * 10);
+
+	k_spinlock_key_t key = k_spin_lock(&link_lock);
+	link.interval = interval;
+	link.latency = latency;
+	link.timeout = timeout;
+	k_spin_unlock(&link_lock, key);
+
+	k_work_submit(&report_work);
+}
+
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+static void link_le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+	LOG_INF("PHY TX %u RX %u", param->tx_phy, param->rx_phy);
+
+	k_spinlock_key_t key = k_spin_lock(&link_lock);
+	link.tx_phy = param->tx_phy;
+	link.rx_phy = param->rx_phy;
+	k_spin_unlock(&link_lock, key);
+
+	k_work_submit(&report_work);
+}
+#endif
+
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+static void link_le_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+	LOG_INF("Data length TX %u RX %u", info->tx_max_len, info->rx_max_len);
+
+	k_spinlock_key_t key = k_spin_lock(&link_lock);
+	link.tx_len = info->tx_max_len;
+	link.rx_len = info->rx_max_len;
+	k_spin_unlock(&link_lock, key);
+
+	k_work_submit(&report_work);
+}
+#endif
+
+BT_CONN_CB_DEFINE(link_conn_callbacks) = {
+	.connected           = link_connected,
+	.disconnected        = link_disconnected,
+	.le_param_updated    = link_le_param_updated,
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+	.le_phy_updated      = link_le_phy_updated,
+#endif
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+	.le_data_len_updated = link_le_data_len_updated,
+#endif
+};
@@ -0,0 +1,34 @@
+#ifndef CONN_PARAMS_H_
+
+#define CONN_PARAMS_H_
+
+#include <zephyr/types.h>
+
+//Connection parameter / PHY / data length tracking and negotiation
+//With CONFIG_MELTY_CONN_NEGOTIATION the bot asks for the control interval (zero latency), 2M PHY
+//and maximum data length after connecting rather than living with whatever the central picked,
+//re-asking with backoff while the central hasn't given it (up to CONFIG_MELTY_CONN_RETRIES times).
+//With CONFIG_MELTY_CONN_POWER_SAVE it drops to the idle interval while throttle is 0
+
+#define CONN_MODE_CONTROL		0
+#define CONN_MODE_POWER_SAVE	1
+
+//what the connection currently runs with - all 0 while disconnected
+struct conn_link {
+	u_int16_t interval;		//1.25 ms units
+	u_int16_t latency;		//connection events
+	u_int16_t timeout;		//supervision timeout, 10 ms units
+	u_int8_t tx_phy;		//BT_GAP_LE_PHY_* - 0 if unknown
+	u_int8_t rx_phy;
+	u_int16_t tx_len;		//max LL payload octets - 0 if unknown
+	u_int16_t rx_len;
+	u_int8_t mode;			//CONN_MODE_* being asked for
+	u_int8_t refusals;		//requests the central didn't act on this connection
+};
+
+void get_conn_link(struct conn_link *link);
+
+//accepted control write - picks control or power save interval
+void conn_params_set_throttle(u_int8_t throttle);
+
+#endif
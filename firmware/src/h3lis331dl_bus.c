@@ -0,0 +1,91 @@
+#include <zephyr/types.h>
+#include <zephyr/device.h>
+#include <string.h>
+#include <errno.h>
+
+#include "h3lis331dl_bus.h"
+
+#if defined(CONFIG_SPI)
+static int spi_write_regs(const struct spi_dt_spec *spi, u_int8_t reg, const u_int8_t *data, u_int16_t len)
+{
+	u_int8_t address = reg | (len > 1 ? H3LIS331DL_SPI_AUTO_INCREMENT : 0);
+	const struct spi_buf tx_bufs[] = {
+		{ .buf = &address, .len = 1 },
+		{ .buf = (u_int8_t *)data, .len = len },
+	};
+	const struct spi_buf_set tx = { .buffers = tx_bufs, .count = ARRAY_SIZE(tx_bufs) };
+
+	return spi_write_dt(spi, &tx);
+}
+
+static int spi_read_regs(const struct spi_dt_spec *spi, u_int8_t reg, u_int8_t *data, u_int16_t len)
+{
+	u_int8_t address = reg | H3LIS331DL_SPI_READ | (len > 1 ? H3LIS331DL_SPI_AUTO_INCREMENT : 0);
+	const struct spi_buf tx_buf = { .buf = &address, .len = 1 };
+	const struct spi_buf_set tx = { .buffers = &tx_buf, .count = 1 };
+	//nothing comes back while the address goes out
+	const struct spi_buf rx_bufs[] = {
+		{ .buf = NULL, .len = 1 },
+		{ .buf = data, .len = len },
+	};
+	const struct spi_buf_set rx = { .buffers = rx_bufs, .count = ARRAY_SIZE(rx_bufs) };
+
+	return spi_transceive_dt(spi, &tx, &rx);
+}
+#endif
+
+#if defined(CONFIG_I2C)
+//address and data in one write - some controllers can't chain two write messages
+static int i2c_write_regs(const struct i2c_dt_spec *i2c, u_int8_t reg, const u_int8_t *data, u_int16_t len)
+{
+	u_int8_t buf[1 + H3LIS331DL_MAX_WRITE_LEN];
+
+	buf[0] = reg | H3LIS331DL_I2C_AUTO_INCREMENT;
+	memcpy(&buf[1], data, len);
+
+	return i2c_write_dt(i2c, buf, len + 1);
+}
+
+//register address write + data read in one transaction (repeated start, no stop in between)
+static int i2c_read_regs(const struct i2c_dt_spec *i2c, u_int8_t reg, u_int8_t *data, u_int16_t len)
+{
+	u_int8_t address = reg | H3LIS331DL_I2C_AUTO_INCREMENT;
+
+	return i2c_write_read_dt(i2c, &address, 1, data, len);
+}
+#endif
+
+int h3lis331dl_bus_write(const struct h3lis331dl_bus *bus, u_int8_t reg, const u_int8_t *data, u_int16_t len)
+{
+	if (len > H3LIS331DL_MAX_WRITE_LEN) return -EINVAL;
+
+#if defined(CONFIG_SPI)
+	if (bus->on_spi) return spi_write_regs(&bus->spi, reg, data, len);
+#endif
+#if defined(CONFIG_I2C)
+	if (!bus->on_spi) return i2c_write_regs(&bus->i2c, reg, data, len);
+#endif
+	return -ENOTSUP;
+}
+
+int h3lis331dl_bus_read(const struct h3lis331dl_bus *bus, u_int8_t reg, u_int8_t *data, u_int16_t len)
+{
+#if defined(CONFIG_SPI)
+	if (bus->on_spi) return spi_read_regs(&bus->spi, reg, data, len);
+#endif
+#if defined(CONFIG_I2C)
+	if (!bus->on_spi) return i2c_read_regs(&bus->i2c, reg, data, len);
+#endif
+	return -ENOTSUP;
+}
+
+bool h3lis331dl_bus_is_ready(const struct h3lis331dl_bus *bus)
+{
+#if defined(CONFIG_SPI)
+	if (bus->on_spi) return spi_is_ready(&bus->spi);
+#endif
+#if defined(CONFIG_I2C)
+	if (!bus->on_spi) return device_is_ready(bus->i2c.bus);
+#endif
+	return false;
+}
@@ -0,0 +1,58 @@
+#ifndef H3LIS331DL_BUS_H_
+
+#define H3LIS331DL_BUS_H_
+
+#include <zephyr/types.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/spi.h>
+#include <stdbool.h>
+
+//H3LIS331DL register transport on whichever bus its devicetree node sits on - shared by the
+//sensor API driver (drivers/sensor/h3lis331dl) and the direct backend (accel_backend_h3lis331dl.c)
+
+//STATUS_REG is immediately followed by OUT_X_L .. OUT_Z_H - one burst gets both
+#define H3LIS331DL_STATUS_AND_DATA_LEN	7
+
+//X axis in counts of the range it was read on (12 bit left justified) - at or past these it's clipped
+#define H3LIS331DL_SATURATED_HIGH_RAW	32752
+#define H3LIS331DL_SATURATED_LOW_RAW	-32768
+
+//mode 3, MSB first
+#define H3LIS331DL_SPI_OPERATION		(SPI_OP_MODE_MASTER | SPI_WORD_SET(8) | SPI_TRANSFER_MSB | \
+										 SPI_MODE_CPOL | SPI_MODE_CPHA)
+//first byte of an SPI transfer - read in bit 7, auto increment (MS) in bit 6
+#define H3LIS331DL_SPI_READ				0x80
+#define H3LIS331DL_SPI_AUTO_INCREMENT	0x40
+//MSB of the I2C register address turns on auto increment
+#define H3LIS331DL_I2C_AUTO_INCREMENT	0x80
+
+struct h3lis331dl_bus {
+	union {
+#if defined(CONFIG_I2C)
+		struct i2c_dt_spec i2c;
+#endif
+#if defined(CONFIG_SPI)
+		struct spi_dt_spec spi;
+#endif
+	};
+	bool on_spi;
+};
+
+//initializer for a st,h3lis331dl node on either bus
+#define H3LIS331DL_BUS_DT_SPEC_GET(node_id)								\
+	COND_CODE_1(DT_ON_BUS(node_id, spi),								\
+		    ({ .spi = SPI_DT_SPEC_GET(node_id, H3LIS331DL_SPI_OPERATION, 0), .on_spi = true }),	\
+		    ({ .i2c = I2C_DT_SPEC_GET(node_id), .on_spi = false }))
+
+//longest register burst one write carries (CTRL_REG1..5 is the longest anyone sends)
+#define H3LIS331DL_MAX_WRITE_LEN		8
+
+//register write / read, bursts of more than one register auto increment - 0 or negative errno
+//writes longer than H3LIS331DL_MAX_WRITE_LEN are refused (-EINVAL)
+int h3lis331dl_bus_write(const struct h3lis331dl_bus *bus, u_int8_t reg, const u_int8_t *data, u_int16_t len);
+int h3lis331dl_bus_read(const struct h3lis331dl_bus *bus, u_int8_t reg, u_int8_t *data, u_int16_t len);
+
+bool h3lis331dl_bus_is_ready(const struct h3lis331dl_bus *bus);
+
+#endif
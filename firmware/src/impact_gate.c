@@ -0,0 +1,53 @@
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <math.h>
+
+#include "impact_gate.h"
+
+//noise allowance in raw counts (~4 sigma)
+#define NOISE_RAW				256
+//fastest change of speed the drive can manage, sqrt(raw counts) per second (0 -> 200 g in ~0.25 s)
+#define MAX_SPEED_RATE			1060.0f
+//after this many rejects in a row trust the sensor again
+#define MAX_REJECTED_SAMPLES	16
+
+static bool primed = false;
+static u_int32_t last_cycles;
+static u_int32_t rejected_in_row;
+
+void impact_gate_reset(void)
+{
+	primed = false;
+	rejected_in_row = 0;
+}
+
+enum impact_gate_verdict impact_gate_check(int32_t accel_raw, u_int32_t timestamp_cycles, int32_t expected_raw)
+{
+	//nothing to compare against yet
+	if (!primed) {
+		primed = true;
+		last_cycles = timestamp_cycles;
+		return IMPACT_GATE_ACCEPT;
+	}
+
+	//accel = speed^2, so a speed change d shows up as 2 * speed * d in raw counts
+	//(speed floored at the noise level so spin-up from standstill isn't gated)
+	//allowed per sample period, not since the last accepted sample - the estimate extrapolates across
+	//rejects, and a ringing hit decays slower than the allowance would grow
+	float expected_speed = sqrtf((float)(expected_raw > NOISE_RAW ? expected_raw : NOISE_RAW));
+	float dt = (float)(timestamp_cycles - last_cycles) / sys_clock_hw_cycles_per_sec();
+	float max_change = NOISE_RAW + 2.0f * expected_speed * MAX_SPEED_RATE * dt;
+	int32_t change = accel_raw - expected_raw;
+	if (change < 0) change = -change;
+
+	last_cycles = timestamp_cycles;
+
+	if (change > max_change && rejected_in_row < MAX_REJECTED_SAMPLES) {
+		return rejected_in_row++ == 0 ? IMPACT_GATE_HIT : IMPACT_GATE_REJECT;
+	}
+
+	enum impact_gate_verdict verdict = rejected_in_row >= MAX_REJECTED_SAMPLES ? IMPACT_GATE_RESTART : IMPACT_GATE_ACCEPT;
+
+	rejected_in_row = 0;
+	return verdict;
+}
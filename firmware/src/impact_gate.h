@@ -0,0 +1,24 @@
+#ifndef IMPACT_GATE_H_
+
+#define IMPACT_GATE_H_
+
+#include <zephyr/types.h>
+
+//Impact gate - a sample further from the estimate than noise plus the fastest physically possible
+//speed change is a hit, not rotation, and never reaches the rpm estimator
+
+enum impact_gate_verdict {
+	IMPACT_GATE_ACCEPT,
+	IMPACT_GATE_HIT,			//rejected - first sample of a new impact
+	IMPACT_GATE_REJECT,			//rejected - rest of the same impact
+	IMPACT_GATE_RESTART,		//accepted after too long a run of rejects - the estimate is the one
+								//that's wrong, restart whatever followed it
+};
+
+void impact_gate_reset(void);
+
+//accel_raw - X axis normalized counts at timestamp_cycles, expected_raw - the rpm estimator's
+//prediction for the same time
+enum impact_gate_verdict impact_gate_check(int32_t accel_raw, u_int32_t timestamp_cycles, int32_t expected_raw);
+
+#endif
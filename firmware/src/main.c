@@ -43,8 +43,6 @@
 
 static int is_connected = 0;
 
-#define HEART_BEAT_CHECK_FREQ_MS 600
-
 static const struct bt_data ad[] = {
 	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
 	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
@@ -71,6 +69,7 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
 	printk("Disconnected (reason %u)\n", reason);
 	clear_melty_parameters_initialized();
+	reset_control_sequence();
 	is_connected = 0;
 
 }
@@ -151,27 +150,6 @@ static struct bt_conn_auth_cb conn_auth_callbacks;
 #endif
 
 
-bool check_heart_beat(void)
-{
-	static bool heart_beat_good = false;
-	static uint8_t last_heart_beat = 0;
-	static uint64_t time_at_last_check = 0;
-
-	if (k_uptime_get() - time_at_last_check > HEART_BEAT_CHECK_FREQ_MS) {
-		time_at_last_check = k_uptime_get();
-		int current_heart_beat = get_heart_beat();
-		//heartbeat must be a new number - and between 10 and 13 (inclusive)
-		if (current_heart_beat != last_heart_beat && current_heart_beat >= 10 && current_heart_beat <= 13) {
-			last_heart_beat = current_heart_beat;
-			heart_beat_good = true;
-		} else {
-			heart_beat_good = false;
-		}
-	}
-	
-	return heart_beat_good;
-}
-
 void init_ble() {
 	int err;
 
@@ -219,6 +197,7 @@ void init_ble() {
 
 }
 
+#if defined(CONFIG_MELTY_BATTERY_ADC_POLLED)
 void sample_bat_volt() {
 
 	while(true) {
@@ -226,14 +205,14 @@ void sample_bat_volt() {
 		k_msleep(100);
 	}
 }
+#endif
 
 
 void sample_accel_thread() {
 	init_accel();
 
 	while(true) {
-		update_accel_value();
-		k_msleep(30);
+		if (wait_accel_sample()) update_melty_parameters();
 	}
 }
 
@@ -244,10 +223,12 @@ void main(void)
 	
 	init_melty();
 
+	init_volt_monitor();
+
 	while (1)
 	{
 		while (is_connected == 1 && get_melty_parameters_initialized()
-		 && get_throttle() != 0 && check_heart_beat()) {
+		 && get_throttle() != 0 && get_control_valid()) {
 			do_melty();
 		}
 		
@@ -264,7 +245,9 @@ void main(void)
 K_THREAD_DEFINE(sample_accel_thread0_id, STACKSIZE, sample_accel_thread, NULL, NULL, NULL,
 		PRIORITY, 0, 0);
 
+#if defined(CONFIG_MELTY_BATTERY_ADC_POLLED)
 K_THREAD_DEFINE(sample_bat_volt0_id, STACKSIZE, sample_bat_volt, NULL, NULL, NULL,
 		PRIORITY, 0, 0);
+#endif
 
 
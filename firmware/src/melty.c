@@ -17,90 +17,121 @@
 #include "analog_in.h"
 #include "accel.h"
 #include "volt_monitor.h"
+#include "rotation_lut.h"
+#include "battery_load.h"
+#include "rotation_phase.h"
+
+#if defined(CONFIG_MELTY_HW_EDGE_TIMING)
+#include "motor_timer.h"
+#endif
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+#include "conn_params.h"
+#endif
 
 #define MELTY_LED_PIN			13
 #define MOTOR_PIN1				4
 #define MOTOR_PIN2				3
 
-#define ZERO_G_OFFSET_SAMPLES	30
-
 
 //full power spin in below this number
 #define MIN_TRANSLATION_RPM                    250
-#define MAX_TRANSLATION_ROTATION_INTERVAL_US   (1.0f / MIN_TRANSLATION_RPM) * 60 * 1000 * 1000
+#define MAX_TRANSLATION_ROTATION_INTERVAL_US   (60UL * 1000 * 1000 / MIN_TRANSLATION_RPM)
 
 //don't even try to do heading track if we are this slow
-//limits max time spent in do_melty (helps assure heartbeat is checked at safe interval)
-#define MAX_TRACKING_ROTATION_INTERVAL_US   MAX_TRANSLATION_ROTATION_INTERVAL_US * 2
+//limits max time spent in do_melty (how long a rotation can run on between control valid checks)
+#define MAX_TRACKING_ROTATION_INTERVAL_US   (MAX_TRANSLATION_ROTATION_INTERVAL_US * 2)
 
+#define BENCHMARK_REPORT_ROTATIONS	500
 
-static const struct device *dev;
 
-static float zero_g_accel;
+static const struct device *dev;
 
 
 void init_melty(void){
 
 	dev = DEVICE_DT_GET(DT_NODELABEL(gpio0));
 
+	init_rotation_lut();
+
 	gpio_pin_configure(dev, MELTY_LED_PIN, GPIO_OUTPUT); 
 	gpio_pin_configure(dev, MOTOR_PIN1, GPIO_OUTPUT); 
 	gpio_pin_configure(dev, MOTOR_PIN2, GPIO_OUTPUT); 
 
-	for (int x = 0; x < ZERO_G_OFFSET_SAMPLES; x++) {
-		zero_g_accel += get_accel_g();
+#if defined(CONFIG_MELTY_LOOP_CYCLE_BENCHMARK) || defined(CONFIG_MELTY_TELEMETRY_STALL_BENCHMARK)
+	//start DWT cycle counter
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+#if defined(CONFIG_MELTY_HW_EDGE_TIMING)
+	int err = motor_timer_init(MOTOR_PIN1, MOTOR_PIN2, MELTY_LED_PIN);
+	if (err) {
+		printk("Motor timer init failed (err %d)\n", err);
 	}
-	zero_g_accel = zero_g_accel / ZERO_G_OFFSET_SAMPLES;
-
+#endif
 }
 
+//cleared by motors_safe - the next do_melty starts phase from there instead of integrating the idle time
+static volatile bool spinning = false;
+
 void motors_safe(void) {
+	spinning = false;
+
+#if defined(CONFIG_MELTY_HW_EDGE_TIMING)
+	//returns pins to GPIO control
+	motor_timer_stop();
+#endif
+
     //motor off!
 	gpio_pin_set(dev, MOTOR_PIN1, 0);
 	gpio_pin_set(dev, MOTOR_PIN2, 0);
 }
 
+void motors_disarm(void) {
+#if defined(CONFIG_MELTY_HW_EDGE_TIMING)
+	//a rotation queued from the control loop after this point is refused, not started
+	motor_timer_disarm();
+#endif
+	motors_safe();
+}
 
-static float get_rotation_interval_ms(void){
-
-	//increasing causes tracking speed to decrease
-	float radius_in_cm = get_radius();
-
- 	//calculate RPM from g's - derived from "G = 0.00001118 * r * RPM^2"
-	float rpm;
-	rpm = get_accel_g() * 89445.0f;                               
-	rpm = rpm / radius_in_cm;
-	rpm = sqrt(rpm);	
-
-	float rotation_interval = (1.0f / rpm) * 60 * 1000;
-	if (rotation_interval > 250) rotation_interval = 250;
-	if (rotation_interval < 0) rotation_interval = 250;
-	return rotation_interval;
+void motors_arm(void) {
+#if defined(CONFIG_MELTY_HW_EDGE_TIMING)
+	motor_timer_arm();
+#endif
 }
 
 
+//advanced by the polling loop, never reset at rotation boundary
+static struct rotation_phase rotation_phase;
 
-static struct melty_parameters_t get_melty_parameters(void) {
+static struct melty_parameters_t compute_melty_parameters(void) {
 
-	float led_offset_portion = get_led_offset() / 100.0f;
-	float motor_on_portion = get_throttle() / 100.0f;	
-	float led_on_portion = .4f * (1.1f - motor_on_portion);     //LED width changed with throttle
+	u_int32_t led_offset_percent = get_led_offset();
+	u_int32_t motor_on_percent = get_throttle();
+	if (motor_on_percent > 100) motor_on_percent = 100;
+	u_int32_t led_on_permille = 4 * (110 - motor_on_percent);     //LED width changed with throttle (40% of 1.1 - throttle)
 
 	struct melty_parameters_t melty_parameters;
-	melty_parameters.rotation_interval_us = get_rotation_interval_ms() * 1000;
+
+	//only rebuilds its scale factor when radius actually changed
+	set_rotation_lut_radius(get_radius_raw());
+	melty_parameters.rotation_interval_us = get_rotation_interval_us(get_accel_raw());
 
 	//if under defined RPM - just try to spin up
-    if (melty_parameters.rotation_interval_us > MAX_TRANSLATION_ROTATION_INTERVAL_US) motor_on_portion = 1;
+    if (melty_parameters.rotation_interval_us > MAX_TRANSLATION_ROTATION_INTERVAL_US) motor_on_percent = 100;
 
     //if we are too slow - don't even try to track heading
 	if (melty_parameters.rotation_interval_us > MAX_TRACKING_ROTATION_INTERVAL_US) {
         melty_parameters.rotation_interval_us = MAX_TRACKING_ROTATION_INTERVAL_US;
     }
 
-	u_int32_t motor_on_us = motor_on_portion * melty_parameters.rotation_interval_us;
+	u_int32_t motor_on_us = motor_on_percent * melty_parameters.rotation_interval_us / 100;
 	
-    u_int32_t led_on_us = led_on_portion * melty_parameters.rotation_interval_us;
-	u_int32_t led_offset_us = led_offset_portion * melty_parameters.rotation_interval_us;
+    u_int32_t led_on_us = led_on_permille * melty_parameters.rotation_interval_us / 1000;
+	u_int32_t led_offset_us = led_offset_percent * melty_parameters.rotation_interval_us / 100;
 
     //center LED on offset
 	if (led_on_us / 2 <= led_offset_us) {
@@ -120,54 +151,462 @@ static struct melty_parameters_t get_melty_parameters(void) {
 	melty_parameters.motor_start2 = melty_parameters.rotation_interval_us - (motor_on_us / 2);
 	melty_parameters.motor_stop2 = motor_on_us / 2;
 
+	//same edges as rotation phase - lets the loop run on integer compares only
+	melty_parameters.led_start_phase = us_to_phase(melty_parameters.led_start, melty_parameters.rotation_interval_us);
+	melty_parameters.led_stop_phase = us_to_phase(melty_parameters.led_stop, melty_parameters.rotation_interval_us);
+	melty_parameters.motor_start1_phase = us_to_phase(melty_parameters.motor_start1, melty_parameters.rotation_interval_us);
+	melty_parameters.motor_stop1_phase = us_to_phase(melty_parameters.motor_stop1, melty_parameters.rotation_interval_us);
+	melty_parameters.motor_start2_phase = us_to_phase(melty_parameters.motor_start2, melty_parameters.rotation_interval_us);
+	melty_parameters.motor_stop2_phase = us_to_phase(melty_parameters.motor_stop2, melty_parameters.rotation_interval_us);
+
+	set_phase_rate(&melty_parameters.phase_rate, melty_parameters.rotation_interval_us, sys_clock_hw_cycles_per_sec());
+
 	return melty_parameters;
 
 }
 
+//latest parameters - only rebuilt when an accel sample or BLE config arrives
+static struct melty_parameters_t published_parameters;
+static atomic_t published_parameters_seq = ATOMIC_INIT(0);
+static struct k_spinlock published_parameters_lock;
+K_MUTEX_DEFINE(update_parameters_mutex);
+
+void update_melty_parameters(void) {
+	//serializes accel / BLE updaters so an older computation can't overwrite a newer one
+	k_mutex_lock(&update_parameters_mutex, K_FOREVER);
+
+	struct melty_parameters_t melty_parameters = compute_melty_parameters();
+
+	k_spinlock_key_t key = k_spin_lock(&published_parameters_lock);
+	published_parameters = melty_parameters;
+	k_spin_unlock(&published_parameters_lock, key);
+
+	atomic_inc(&published_parameters_seq);
+
+	k_mutex_unlock(&update_parameters_mutex);
+}
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+#define CONTROL_LATENCY_REPORT_WRITES	100
+//connection intervals kept apart in the report (control and power save, plus whatever the central picks)
+#define CONTROL_LATENCY_INTERVALS		4
+
+struct control_latency {
+	u_int16_t interval;		//1.25 ms units - 0 for an unused slot
+	u_int32_t count;
+	u_int64_t total_us;
+	u_int32_t max_us;
+};
+
+static struct control_latency control_latency[CONTROL_LATENCY_INTERVALS];
+static u_int32_t control_latency_count = 0;
+static u_int32_t control_latency_untimed = 0;	//interval slots all taken by others
+
+//accept time of the newest write picked up whose first motor edge hasn't happened yet - 0 if none
+//(a write replaced before that edge is never timed)
+static u_int32_t control_write_cycles = 0;
+
+static void pick_up_control_write(void) {
+	u_int32_t write_cycles = take_control_write_cycles();
+	if (write_cycles != 0) control_write_cycles = write_cycles;
+}
+
+//control write accepted -> first motor edge switched on it, kept per connection interval -
+//over the air latency (up to one interval for a write without response) comes on top
+static void record_control_latency(u_int32_t latency_us) {
+	struct conn_link link;
+	struct control_latency *slot = NULL;
+
+	get_conn_link(&link);
+
+	for (int x = 0; x < CONTROL_LATENCY_INTERVALS; x++) {
+		if (control_latency[x].interval == link.interval || control_latency[x].interval == 0) {
+			slot = &control_latency[x];
+			break;
+		}
+	}
+
+	if (slot == NULL) {
+		control_latency_untimed++;
+	} else {
+		slot->interval = link.interval;
+		slot->count++;
+		slot->total_us += latency_us;
+		if (latency_us > slot->max_us) slot->max_us = latency_us;
+	}
+
+	if (++control_latency_count < CONTROL_LATENCY_REPORT_WRITES) return;
+
+	u_int32_t commands, requests, lost, stale;
+	get_control_write_counts(&commands, &requests, &lost, &stale);
+
+	printk("Control latency to motor edge over %u writes - %u without response %u acknowledged, %u lost %u stale\n",
+		control_latency_count, commands, requests, lost, stale);
+
+	for (int x = 0; x < CONTROL_LATENCY_INTERVALS && control_latency[x].interval != 0; x++) {
+		slot = &control_latency[x];
+		printk("  %u.%02u ms interval: mean %u us max %u us over %u writes (+ up to %u.%02u ms over the air)\n",
+			slot->interval * 5 / 4, slot->interval * 125 % 100, (u_int32_t)(slot->total_us / slot->count),
+			slot->max_us, slot->count, slot->interval * 5 / 4, slot->interval * 125 % 100);
+	}
+	if (control_latency_untimed != 0) printk("  %u writes at other intervals\n", control_latency_untimed);
+
+	memset(control_latency, 0, sizeof(control_latency));
+	control_latency_count = 0;
+	control_latency_untimed = 0;
+}
+
+//called each pass once the pins are driven - window1 / window2 are the motor windows the pins follow
+//(swapped between motors by translate direction), a change in either is a motor edge
+static void record_control_edge(bool window1, bool window2) {
+	static bool last_window1 = false;
+	static bool last_window2 = false;
+
+	bool edge = window1 != last_window1 || window2 != last_window2;
+	last_window1 = window1;
+	last_window2 = window2;
+
+	if (!edge || control_write_cycles == 0) return;
+
+	record_control_latency(k_cyc_to_us_floor32(k_cycle_get_32() - control_write_cycles));
+	control_write_cycles = 0;
+}
+#endif
+
+//copies in published parameters only if they changed since last call
+static void refresh_melty_parameters(struct melty_parameters_t *melty_parameters) {
+	static atomic_val_t seen_seq = 0;
+
+	atomic_val_t seq = atomic_get(&published_parameters_seq);
+	if (seq == seen_seq) return;
+
+	k_spinlock_key_t key = k_spin_lock(&published_parameters_lock);
+	*melty_parameters = published_parameters;
+	k_spin_unlock(&published_parameters_lock, key);
+
+	seen_seq = seq;
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+	pick_up_control_write();
+#endif
+}
+
 void update_melty_stats(int rotation_interval_ms, float battery_voltage) {
 	u_int8_t melty_stats[3] = {0, 0, 0};
 	melty_stats[0] = rotation_interval_ms;
 	melty_stats[2] = battery_voltage * 10.0f;
+
+#if defined(CONFIG_MELTY_TELEMETRY_DEFERRED)
+	bt_queue_melty_stats(melty_stats);
+#else
 	bt_send_melty_stats(melty_stats);
+#endif
 }
 
+#if defined(CONFIG_MELTY_TELEMETRY_V2)
+//one record per do_melty pass - jitter is how far the pass came from the previous rotation interval
+static void queue_rotation_record(const struct melty_parameters_t *melty_parameters) {
+	static u_int16_t sequence = 0;
+	static u_int32_t last_cycles = 0;
+	static u_int32_t last_interval_us = 0;
+	struct melty_telemetry_record record;
+	struct battery_load_stats battery;
+	struct sensor_sample battery_sample;
+
+	u_int32_t now = k_cycle_get_32();
+	u_int32_t elapsed_us = k_cyc_to_us_floor32(now - last_cycles);
+	u_int32_t jitter_us = elapsed_us > last_interval_us ? elapsed_us - last_interval_us : last_interval_us - elapsed_us;
+	last_cycles = now;
+	last_interval_us = melty_parameters->rotation_interval_us;
+
+	get_battery_sample(&battery_sample);
+	get_battery_load_stats(&battery);
+
+	record.sequence = sequence++;
+	record.rotation_interval_us = melty_parameters->rotation_interval_us;
+	record.accel_raw = get_accel_raw();
+	record.battery_mv = CLAMP(battery_sample.raw, 0, UINT16_MAX);
+	record.loaded_mv = CLAMP(battery.loaded.raw, 0, UINT16_MAX);
+	record.unloaded_mv = CLAMP(battery.unloaded.raw, 0, UINT16_MAX);
+	record.loop_jitter_us = MIN(jitter_us, UINT16_MAX);
+	record.spin_rate_rpm_s = CLAMP(get_spin_rate_rpm_s(), INT16_MIN, INT16_MAX);
+
+	bt_queue_melty_record(&record);
+}
+#endif
+
+//everything the control loop hands to BLE each rotation
+static void hand_off_telemetry(const struct melty_parameters_t *melty_parameters) {
+	update_melty_stats(melty_parameters->rotation_interval_us / 1000, get_battery_voltage());
+#if defined(CONFIG_MELTY_TELEMETRY_V2)
+	queue_rotation_record(melty_parameters);
+#endif
+}
+
+#if defined(CONFIG_MELTY_TELEMETRY_STALL_BENCHMARK)
+static u_int32_t stats_calls = 0;
+static u_int64_t stats_cycles_total = 0;
+static u_int32_t stats_cycles_max = 0;
+
+//DWT cycles - a queued hand off is a few us, under one k_cycle_get_32() tick
+static void timed_hand_off_telemetry(const struct melty_parameters_t *melty_parameters) {
+	u_int32_t start_cycles = DWT->CYCCNT;
+	hand_off_telemetry(melty_parameters);
+	u_int32_t cycles = DWT->CYCCNT - start_cycles;
+
+	stats_calls++;
+	stats_cycles_total += cycles;
+	if (cycles > stats_cycles_max) stats_cycles_max = cycles;
+}
+
+static u_int32_t cycles_to_tenth_us(u_int64_t cycles) {
+	return (u_int32_t)(cycles * 10000000 / SystemCoreClock);
+}
+
+static void report_telemetry_stall(u_int32_t cycle_count) {
+	if (cycle_count % BENCHMARK_REPORT_ROTATIONS != 0 || stats_calls == 0) return;
+
+	u_int32_t mean = cycles_to_tenth_us(stats_cycles_total / stats_calls);
+	u_int32_t max = cycles_to_tenth_us(stats_cycles_max);
+
+#if defined(CONFIG_MELTY_TELEMETRY_DEFERRED)
+	printk("Telemetry stall (queued%s): ", IS_ENABLED(CONFIG_MELTY_TELEMETRY_V2) ? " + v2 record" : "");
+#else
+	printk("Telemetry stall (direct notify): ");
+#endif
+	printk("mean %u.%u us max %u.%u us over %u rotations\n", mean / 10, mean % 10, max / 10, max % 10, stats_calls);
+
+	stats_calls = 0;
+	stats_cycles_total = 0;
+	stats_cycles_max = 0;
+}
+#endif
+
+#if defined(CONFIG_MELTY_LOOP_CYCLE_BENCHMARK)
+static u_int32_t loop_passes = 0;
+static u_int64_t loop_cycles_total = 0;
+static u_int32_t loop_cycles_max = 0;
+
+static void record_loop_cycles(u_int32_t cycles) {
+	loop_passes++;
+	loop_cycles_total += cycles;
+	if (cycles > loop_cycles_max) loop_cycles_max = cycles;
+}
+
+static void report_loop_cycles(u_int32_t cycle_count) {
+	if (cycle_count % BENCHMARK_REPORT_ROTATIONS != 0 || loop_passes == 0) return;
+
+	printk("Loop body (%s): passes %u mean %u cycles max %u cycles\n",
+		IS_ENABLED(CONFIG_MELTY_LOOP_CYCLE_BASELINE) ? "rebuild every pass" : "copy on change",
+		loop_passes, (u_int32_t)(loop_cycles_total / loop_passes), loop_cycles_max);
+
+	loop_passes = 0;
+	loop_cycles_total = 0;
+	loop_cycles_max = 0;
+}
+#endif
+
+#if defined(CONFIG_MELTY_EDGE_LATENESS_BENCHMARK)
+static u_int32_t edges_measured = 0;
+static u_int32_t edge_late_total_us = 0;
+static u_int32_t edge_late_max_us = 0;
+
+//records lateness of any edge crossed by the last phase step (wraps through end of rotation)
+static void record_edge_lateness(u_int32_t edge_phase, u_int32_t last_phase, u_int32_t phase_step, u_int32_t rotation_interval_us) {
+	u_int32_t since_edge = (last_phase + phase_step) - edge_phase;
+
+	if (since_edge < phase_step) {
+		u_int32_t late_us = ((u_int64_t)since_edge * rotation_interval_us) >> 32;
+		edges_measured++;
+		edge_late_total_us += late_us;
+		if (late_us > edge_late_max_us) edge_late_max_us = late_us;
+	}
+}
+
+static void report_edge_lateness(u_int32_t cycle_count) {
+	if (cycle_count % BENCHMARK_REPORT_ROTATIONS != 0) return;
+
+#if defined(CONFIG_MELTY_HW_EDGE_TIMING)
+	struct motor_timer_stats stats;
+	motor_timer_get_stats(&stats);
+	printk("Late edges (hw): rotations %u underruns %u applied in sw %u max late %u us max reload %u us\n",
+		stats.rotations, stats.underruns, stats.late_edges, stats.max_late_us, stats.max_reload_us);
+#if defined(CONFIG_MELTY_EDGE_CAPTURE_PIN)
+	if (stats.timed_edges > 0) {
+		printk("Edge error (hw, motor 1 on P0.%d): edges %u mean %d us min %d us max %d us missed %u\n",
+			CONFIG_MELTY_EDGE_CAPTURE_PIN, stats.timed_edges, stats.edge_error_total_us / (int32_t)stats.timed_edges,
+			stats.edge_error_min_us, stats.edge_error_max_us, stats.missed_edges);
+	} else {
+		printk("Edge error (hw, motor 1 on P0.%d): no edges captured, missed %u\n",
+			CONFIG_MELTY_EDGE_CAPTURE_PIN, stats.missed_edges);
+	}
+#endif
+#else
+	if (edges_measured > 0) {
+		printk("Late edges (sw): edges %u mean late %u us max late %u us\n",
+			edges_measured, edge_late_total_us / edges_measured, edge_late_max_us);
+	}
+	edges_measured = 0;
+	edge_late_total_us = 0;
+	edge_late_max_us = 0;
+#endif
+}
+#endif
+
+#if defined(CONFIG_MELTY_HW_EDGE_TIMING)
+//converts an inclusive on window (as evaluated by the polling loop) into hardware edges
+static void window_to_edges(u_int32_t start, u_int32_t stop, bool wraps, u_int32_t rotation_interval_us,
+	u_int32_t *on, u_int32_t *off) {
+
+	if (wraps && start <= stop) {
+		//whole rotation
+		*on = 0;
+		*off = MOTOR_TIMER_EDGE_NEVER;
+		return;
+	}
+
+	if (!wraps && start >= stop) {
+		//empty window
+		*on = MOTOR_TIMER_EDGE_NEVER;
+		*off = 0;
+		return;
+	}
+
+	//edges at / past the end of rotation would carry over into the next one
+	*on = start < rotation_interval_us ? start : MOTOR_TIMER_EDGE_NEVER;
+	*off = stop < rotation_interval_us ? stop : MOTOR_TIMER_EDGE_NEVER;
+}
+
+static void do_melty_hw(struct melty_parameters_t *melty_parameters, u_int32_t cycle_count) {
+	struct motor_timer_edges edges;
+	u_int32_t interval = melty_parameters->rotation_interval_us;
+	u_int32_t window1_on, window1_off, window2_on, window2_off;
+
+	window_to_edges(melty_parameters->motor_start1, melty_parameters->motor_stop1, false, interval,
+		&window1_on, &window1_off);
+	window_to_edges(melty_parameters->motor_start2, melty_parameters->motor_stop2, true, interval,
+		&window2_on, &window2_off);
+	window_to_edges(melty_parameters->led_start, melty_parameters->led_stop,
+		melty_parameters->led_start > melty_parameters->led_stop, interval,
+		&edges.led_on, &edges.led_off);
+
+	edges.rotation_interval_us = interval;
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+	//timed by motor_timer as the rotation is loaded
+	edges.control_write_cycles = control_write_cycles;
+	control_write_cycles = 0;
+#endif
+
+	if (get_translate_direction() == TRANSLATE_REVERSE || (get_translate_direction() == TRANSLATE_IDLE && cycle_count % 2 == 1)) {
+		edges.motor1_on = window2_on;
+		edges.motor1_off = window2_off;
+		edges.motor2_on = window1_on;
+		edges.motor2_off = window1_off;
+	} else {
+		edges.motor1_on = window1_on;
+		edges.motor1_off = window1_off;
+		edges.motor2_on = window2_on;
+		edges.motor2_off = window2_off;
+	}
+
+	//returns once the previously queued rotation has started playing out
+	//refused once the failsafe has disarmed the timer, however late in do_melty it fired
+	if (motor_timer_queue_rotation(&edges, K_USEC(MAX_TRACKING_ROTATION_INTERVAL_US * 2)) != 0) {
+		motors_safe();
+	}
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+	//the rotation queued on the previous pass has just been loaded
+	u_int32_t latency_us;
+	if (motor_timer_take_control_latency(&latency_us)) record_control_latency(latency_us);
+#endif
+}
+#endif
+
 void do_melty(void){
-		
-	u_int32_t time_spent_this_rotation_us = 0;
 
 	int sleep_time_us = 10;
 
 	static u_int32_t cycle_count = 0;
 
-	/* capture initial time stamp */
-	u_int32_t start_time;
-	start_time = k_cycle_get_32();
+	//snapshot is kept between calls and only re-copied when changed
+	static struct melty_parameters_t melty_parameters;
+	refresh_melty_parameters(&melty_parameters);
 
-	struct melty_parameters_t melty_parameters = get_melty_parameters();
-
-	update_melty_stats(melty_parameters.rotation_interval_us / 1000, get_battery_voltage());
+#if defined(CONFIG_MELTY_TELEMETRY_STALL_BENCHMARK)
+	timed_hand_off_telemetry(&melty_parameters);
+#else
+	hand_off_telemetry(&melty_parameters);
+#endif
 
 	cycle_count++;
 
-	while(time_spent_this_rotation_us < melty_parameters.rotation_interval_us) {
-		u_int32_t stop_time;
-		int64_t cycles_spent;
+#if defined(CONFIG_MELTY_TELEMETRY_STALL_BENCHMARK)
+	report_telemetry_stall(cycle_count);
+#endif
+
+#if defined(CONFIG_MELTY_EDGE_LATENESS_BENCHMARK)
+	report_edge_lateness(cycle_count);
+#endif
+
+#if defined(CONFIG_MELTY_LOOP_CYCLE_BENCHMARK)
+	report_loop_cycles(cycle_count);
+#endif
+
+#if defined(CONFIG_MELTY_HW_EDGE_TIMING)
+	do_melty_hw(&melty_parameters, cycle_count);
+	return;
+#endif
+
+	if (!spinning) {
+		start_rotation_phase(&rotation_phase, k_cycle_get_32());
+		spinning = true;
+	}
+
+	//phase keeps running between calls - time spent outside the loop still counts towards the next rotation
+	u_int32_t rotations_completed = 0;
 
-        melty_parameters = get_melty_parameters();
+	while(rotations_completed == 0) {
+		u_int32_t phase = rotation_phase.phase;
 
 		//assures BLE gets time to do it's thing
 		k_sleep(K_USEC(sleep_time_us));
 
+#if defined(CONFIG_MELTY_LOOP_CYCLE_BENCHMARK)
+		u_int32_t body_start_cycles = DWT->CYCCNT;
+#endif
+
+#if defined(CONFIG_MELTY_LOOP_CYCLE_BASELINE)
+		//every pass used to rebuild the parameters itself - timed for the before figure
+		melty_parameters = compute_melty_parameters();
+#else
+		refresh_melty_parameters(&melty_parameters);
+#endif
+
+		//failsafe tripped mid rotation - a pin set after it ran would otherwise stay on until we return
+		if (!get_control_valid()) {
+			motors_safe();
+			return;
+		}
+
+		u_int32_t motor_start1 = melty_parameters.motor_start1_phase;
+		u_int32_t motor_stop1 = melty_parameters.motor_stop1_phase;
+		u_int32_t motor_start2 = melty_parameters.motor_start2_phase;
+		u_int32_t motor_stop2 = melty_parameters.motor_stop2_phase;
+		u_int32_t led_start = melty_parameters.led_start_phase;
+		u_int32_t led_stop = melty_parameters.led_stop_phase;
+
 		if (get_translate_direction() == TRANSLATE_FORWARD || (get_translate_direction() == TRANSLATE_IDLE && cycle_count % 2 == 0)) {
-			if (time_spent_this_rotation_us >= melty_parameters.motor_start1 && 
-				time_spent_this_rotation_us <= melty_parameters.motor_stop1) {
+			if (phase >= motor_start1 && 
+				phase <= motor_stop1) {
 					gpio_pin_set(dev, MOTOR_PIN1, 1);
 			} else {
 					gpio_pin_set(dev, MOTOR_PIN1, 0);
 			}
 
-			if (time_spent_this_rotation_us >= melty_parameters.motor_start2 || 
-				time_spent_this_rotation_us <= melty_parameters.motor_stop2) {
+			if (phase >= motor_start2 || 
+				phase <= motor_stop2) {
 					gpio_pin_set(dev, MOTOR_PIN2, 1);
 			} else {
 					gpio_pin_set(dev, MOTOR_PIN2, 0);
@@ -176,15 +615,15 @@ void do_melty(void){
 		}
 
 		if (get_translate_direction() == TRANSLATE_REVERSE || (get_translate_direction() == TRANSLATE_IDLE && cycle_count %2 == 1)) {
-			if (time_spent_this_rotation_us >= melty_parameters.motor_start2 || 
-				time_spent_this_rotation_us <= melty_parameters.motor_stop2) {
+			if (phase >= motor_start2 || 
+				phase <= motor_stop2) {
 					gpio_pin_set(dev, MOTOR_PIN1, 1);
 			} else {
 					gpio_pin_set(dev, MOTOR_PIN1, 0);
 			}
 
-		if (time_spent_this_rotation_us >= melty_parameters.motor_start1 && 
-				time_spent_this_rotation_us <= melty_parameters.motor_stop1) {
+		if (phase >= motor_start1 && 
+				phase <= motor_stop1) {
 					gpio_pin_set(dev, MOTOR_PIN2, 1);
 			} else {
 					gpio_pin_set(dev, MOTOR_PIN2, 0);
@@ -192,29 +631,44 @@ void do_melty(void){
 
 		}
 		
-		if (melty_parameters.led_start > melty_parameters.led_stop) {
-    		if (time_spent_this_rotation_us >= melty_parameters.led_start || time_spent_this_rotation_us <= melty_parameters.led_stop) {
+		if (led_start > led_stop) {
+    		if (phase >= led_start || phase <= led_stop) {
 				gpio_pin_set(dev, MELTY_LED_PIN, 1);
 			} else {
 				gpio_pin_set(dev, MELTY_LED_PIN, 0);
 			}
 		} else {
-			if (time_spent_this_rotation_us >= melty_parameters.led_start && time_spent_this_rotation_us <= melty_parameters.led_stop) {
+			if (phase >= led_start && phase <= led_stop) {
 				gpio_pin_set(dev, MELTY_LED_PIN, 1);
 			} else {
 				gpio_pin_set(dev, MELTY_LED_PIN, 0);
 			}
 		}
-		
-		/* capture final time stamp */
-		stop_time = k_cycle_get_32();
 
-		cycles_spent = stop_time - start_time;
-		if (cycles_spent < 0) cycles_spent = cycles_spent + UINT32_MAX;
-		time_spent_this_rotation_us += SYS_CLOCK_HW_CYCLES_TO_NS_AVG(cycles_spent, 1) / 1000;
-		start_time = k_cycle_get_32();
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+		record_control_edge(phase >= motor_start1 && phase <= motor_stop1, phase >= motor_start2 || phase <= motor_stop2);
+#endif
+		
+		rotations_completed = advance_rotation_phase(&rotation_phase, &melty_parameters.phase_rate, k_cycle_get_32());
+
+#if defined(CONFIG_MELTY_LOOP_CYCLE_BENCHMARK)
+		record_loop_cycles(DWT->CYCCNT - body_start_cycles);
+#endif
+
+#if defined(CONFIG_MELTY_EDGE_LATENESS_BENCHMARK)
+		//pins for the new phase are only set on the next pass - any edge crossed here lands that late
+		u_int32_t phase_step = rotation_phase.phase - phase;
+		record_edge_lateness(motor_start1, phase, phase_step, melty_parameters.rotation_interval_us);
+		record_edge_lateness(motor_stop1, phase, phase_step, melty_parameters.rotation_interval_us);
+		record_edge_lateness(motor_start2, phase, phase_step, melty_parameters.rotation_interval_us);
+		record_edge_lateness(motor_stop2, phase, phase_step, melty_parameters.rotation_interval_us);
+		record_edge_lateness(led_start, phase, phase_step, melty_parameters.rotation_interval_us);
+		record_edge_lateness(led_stop, phase, phase_step, melty_parameters.rotation_interval_us);
+#endif
 	}
 
+	//one was counted on the way in - a pass stretched past a whole rotation keeps the idle alternation in step
+	cycle_count += rotations_completed - 1;
 }
 
 void status_led_flash(int connected) {
@@ -2,13 +2,22 @@
 
 #define MELTY_CONTROL_H_
 
+#include "rotation_phase.h"
+
 void do_melty(void);
 void init_melty(void);
 void motors_safe(void);
+//motors_safe, and no rotation is started again until motors_arm - failsafe timer / disconnect
+void motors_disarm(void);
+//a valid control write came in - rotations may run again
+void motors_arm(void);
 void status_led_flash(int connected);
 
 void update_melty_stats(int rotation_interval_ms, float battery_voltage);
 
+//rebuilds rotation parameters - call when a new accel sample or BLE config arrives
+void update_melty_parameters(void);
+
 typedef struct melty_parameters_t {
 	u_int32_t rotation_interval_us;
 	u_int32_t led_start;
@@ -17,6 +26,17 @@ typedef struct melty_parameters_t {
 	u_int32_t motor_stop1;
 	u_int32_t motor_start2;
 	u_int32_t motor_stop2;
+
+	//edges above as rotation phase (full u_int32_t range = one rotation)
+	u_int32_t led_start_phase;
+	u_int32_t led_stop_phase;
+	u_int32_t motor_start1_phase;
+	u_int32_t motor_stop1_phase;
+	u_int32_t motor_start2_phase;
+	u_int32_t motor_stop2_phase;
+
+	//phase advance per k_cycle_get_32() cycle
+	struct rotation_phase_rate phase_rate;
 };
 
 #endif
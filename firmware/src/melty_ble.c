@@ -25,18 +25,97 @@
 #include <zephyr/logging/log.h>
 
 #include "melty_ble.h"
+#include "melty.h"
+#include "accel.h"
+#include "accel_cal.h"
+#include "battery_load.h"
+#include "conn_params.h"
+#include "stats_v2.h"
 
 LOG_MODULE_REGISTER(bt_meltble, 3);
 
 static bool                   notify_enabled;
+static bool                   notify_link_enabled;
 
 static bool melty_parameters_initialized = false;
 
 static float radius;
+static u_int16_t radius_raw;
 static u_int8_t led_offset;
 static u_int8_t throttle;
 static u_int8_t translate_direction;
-static u_int8_t heart_beat;
+
+//last accepted control write
+static bool have_sequence = false;
+static u_int32_t last_sequence;
+static u_int32_t last_control_cycles;
+static atomic_t control_valid;
+
+//writes the sequence number says never arrived / came in late or duplicated
+//(a write that is late rather than lost counts in both)
+static u_int32_t control_lost;
+static u_int32_t control_stale;
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+//accept time of the newest write not yet picked up by the control loop - 0 when there is none
+static atomic_t pending_control_cycles;
+static u_int32_t control_commands;		//write without response
+static u_int32_t control_requests;		//acknowledged write
+#endif
+
+//value attributes notifications go out on - looked up in the service by bt_melty_init
+static const struct bt_gatt_attr *stats_attr;
+static const struct bt_gatt_attr *link_attr;
+
+static void failsafe_expired(struct k_timer *timer);
+
+#if defined(CONFIG_MELTY_FAILSAFE_BENCHMARK)
+//last control write to motors stopped, taken in the timer interrupt - printed from the system work
+//queue (a write landing before the report runs doesn't change it)
+static u_int32_t failsafe_latency_cycles;
+
+static void report_failsafe(struct k_work *work);
+
+static K_WORK_DEFINE(failsafe_report_work, report_failsafe);
+#endif
+
+static K_TIMER_DEFINE(failsafe_timer, failsafe_expired, NULL);
+
+#if defined(CONFIG_MELTY_TELEMETRY_DEFERRED)
+//latest stats from the control loop - only ever sent from telemetry_work, so the control
+//thread never calls into the host (and never waits on a TX buffer)
+static struct k_spinlock stats_lock;
+static u_int8_t pending_stats[3];
+static u_int32_t last_sent_ms;
+static u_int32_t conn_interval_ms;
+
+//connection telemetry goes out on - reference held while connected
+static struct k_spinlock conn_lock;
+static struct bt_conn *telemetry_conn;
+
+static void send_telemetry(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(telemetry_work, send_telemetry);
+#endif
+
+#if defined(CONFIG_MELTY_TELEMETRY_V2)
+//largest notification the host can send (ATT MTU - 3) - what the negotiated MTU allows is checked per send
+#define STATS_V2_MAX_PAYLOAD		(CONFIG_BT_L2CAP_TX_MTU - 3)
+
+//per rotation records from the control loop (single producer) to telemetry_work (single consumer)
+//must be a power of 2
+#define RECORD_RING_SIZE			64
+
+static bool notify_v2_enabled;
+
+static atomic_t records_head;
+static atomic_t records_tail;
+static struct melty_telemetry_record records[RECORD_RING_SIZE];
+
+static struct bt_gatt_exchange_params mtu_exchange_params;
+
+static const struct bt_gatt_attr *stats_v2_attr;
+#endif
 
 static void melty_ccc_cfg_changed(const struct bt_gatt_attr *attr,
 				  uint16_t value)
@@ -44,6 +123,20 @@ static void melty_ccc_cfg_changed(const struct bt_gatt_attr *attr,
 	notify_enabled = (value == BT_GATT_CCC_NOTIFY);
 }
 
+static void melty_link_ccc_cfg_changed(const struct bt_gatt_attr *attr,
+				       uint16_t value)
+{
+	notify_link_enabled = (value == BT_GATT_CCC_NOTIFY);
+}
+
+#if defined(CONFIG_MELTY_TELEMETRY_V2)
+static void melty_v2_ccc_cfg_changed(const struct bt_gatt_attr *attr,
+				     uint16_t value)
+{
+	notify_v2_enabled = (value == BT_GATT_CCC_NOTIFY);
+}
+#endif
+
 static ssize_t update_melty_config(struct bt_conn *conn,
 			 const struct bt_gatt_attr *attr,
 			 const void *buf,
@@ -52,7 +145,7 @@ static ssize_t update_melty_config(struct bt_conn *conn,
 	LOG_DBG("Attribute write, handle: %u, conn: %p", attr->handle,
 		(void *)conn);
 
-	if (len != 7U) {
+	if (len != MELTY_CONFIG_LEN) {
 		LOG_DBG("Write led: Incorrect data length");
 		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
 	}
@@ -62,21 +155,227 @@ static ssize_t update_melty_config(struct bt_conn *conn,
 		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
 	}
 
+    u_int32_t sequence = sys_get_le32(&((uint8_t *)buf)[6]);
+
+    //0 (client not sending heartbeats yet) or not newer than the last one accepted - ignored entirely
+    //latest wins - a write without response that arrives behind a newer one is simply dropped
+    if (sequence == 0 || (have_sequence && (int32_t)(sequence - last_sequence) <= 0)) {
+        if (sequence != 0) control_stale++;
+        LOG_DBG("Stale control write %u (last %u)", sequence, last_sequence);
+        return len;
+    }
+
+    if (have_sequence && sequence - last_sequence > 1) {
+        control_lost += sequence - last_sequence - 1;
+        LOG_DBG("Control writes lost: %u (total %u)", sequence - last_sequence - 1, control_lost);
+    }
+
+    have_sequence = true;
+    last_sequence = sequence;
+    last_control_cycles = k_cycle_get_32();
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+    if (flags & BT_GATT_WRITE_FLAG_CMD) {
+        control_commands++;
+    } else {
+        control_requests++;
+    }
+    //0 means none pending
+    atomic_set(&pending_control_cycles, last_control_cycles ? last_control_cycles : 1);
+#endif
+
     melty_parameters_initialized = false;
 
-    radius = (((uint8_t *)buf)[0] + ((uint8_t *)buf)[1] * 256) / 1000.0f;
+    radius_raw = ((uint8_t *)buf)[0] + ((uint8_t *)buf)[1] * 256;
+    radius = radius_raw / 1000.0f;
     led_offset = ((uint8_t *)buf)[2];
     throttle = ((uint8_t *)buf)[3];
     translate_direction = ((int8_t *)buf)[4];
-    heart_beat = ((int8_t *)buf)[5];
-    //byte 6 reserved
+    //byte 5 reserved
+
+    update_melty_parameters();
+    conn_params_set_throttle(throttle);
 
     melty_parameters_initialized = true;
     LOG_DBG("params updated");
 
+    //timer restarted first - an expiry already due can't disarm the motors after they are armed below
+    k_timer_start(&failsafe_timer, K_MSEC(CONFIG_MELTY_CONTROL_TIMEOUT_MS), K_NO_WAIT);
+    atomic_set(&control_valid, 1);
+    motors_arm();
+
 	return len;
 }
 
+static ssize_t write_accel_cal(struct bt_conn *conn,
+			 const struct bt_gatt_attr *attr,
+			 const void *buf,
+			 uint16_t len, uint16_t offset, uint8_t flags)
+{
+	if (len != 1U) {
+		LOG_DBG("Write accel cal: Incorrect data length");
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	if (offset != 0) {
+		LOG_DBG("Write accel cal: Incorrect data offset");
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	switch (((uint8_t *)buf)[0]) {
+	case ACCEL_CAL_CAPTURE:
+		if (accel_cal_start() != 0) return BT_GATT_ERR(BT_ATT_ERR_PROCEDURE_IN_PROGRESS);
+		break;
+	case ACCEL_CAL_CLEAR:
+		accel_cal_clear();
+		break;
+	default:
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+
+	return len;
+}
+
+static ssize_t read_accel_cal(struct bt_conn *conn,
+			 const struct bt_gatt_attr *attr,
+			 void *buf,
+			 uint16_t len, uint16_t offset)
+{
+	struct accel_cal_offsets offsets;
+	u_int8_t value[7];
+
+	value[0] = accel_cal_get(&offsets);
+	sys_put_le16(offsets.x, &value[1]);
+	sys_put_le16(offsets.y, &value[3]);
+	sys_put_le16(offsets.z, &value[5]);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+//sensor values to u16 - negative (sag can come out slightly below 0) reads as 0
+static void put_le16_clamped(int32_t raw, u_int8_t *dst)
+{
+	sys_put_le16(CLAMP(raw, 0, UINT16_MAX), dst);
+}
+
+static ssize_t read_battery(struct bt_conn *conn,
+			 const struct bt_gatt_attr *attr,
+			 void *buf,
+			 uint16_t len, uint16_t offset)
+{
+	struct battery_load_stats stats;
+	u_int8_t value[11];
+
+	get_battery_load_stats(&stats);
+
+	//sequence 0 = never published
+	value[0] = (stats.loaded.sequence ? BATTERY_LOADED_VALID : 0) |
+		   (stats.unloaded.sequence ? BATTERY_UNLOADED_VALID : 0) |
+		   (stats.open_circuit.sequence ? BATTERY_OPEN_CIRCUIT_VALID : 0) |
+		   (stats.sag_per_motor.sequence ? BATTERY_SAG_VALID : 0) |
+		   (stats.internal_resistance.sequence ? BATTERY_RESISTANCE_VALID : 0);
+	put_le16_clamped(stats.loaded.raw, &value[1]);
+	put_le16_clamped(stats.unloaded.raw, &value[3]);
+	put_le16_clamped(stats.open_circuit.raw, &value[5]);
+	put_le16_clamped(stats.sag_per_motor.raw, &value[7]);
+	put_le16_clamped(stats.internal_resistance.raw, &value[9]);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+static ssize_t read_accel_stats(struct bt_conn *conn,
+			 const struct bt_gatt_attr *attr,
+			 void *buf,
+			 uint16_t len, uint16_t offset)
+{
+	struct accel_stats stats;
+	u_int8_t value[MELTY_ACCEL_STATS_LEN];
+
+	get_accel_stats(&stats);
+
+	sys_put_le16(MIN(stats.sample_rate_hz, UINT16_MAX), &value[0]);
+	sys_put_le32(stats.samples, &value[2]);
+	sys_put_le32(stats.dropped_samples, &value[6]);
+	sys_put_le32(stats.missed_interrupts, &value[10]);
+	sys_put_le32(stats.impacts, &value[14]);
+	sys_put_le32(stats.rejected_samples, &value[18]);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+static void put_link(u_int8_t value[MELTY_LINK_LEN])
+{
+	struct conn_link link;
+
+	get_conn_link(&link);
+
+	sys_put_le16(link.interval, &value[0]);
+	sys_put_le16(link.latency, &value[2]);
+	sys_put_le16(link.timeout, &value[4]);
+	value[6] = link.tx_phy;
+	value[7] = link.rx_phy;
+	sys_put_le16(link.tx_len, &value[8]);
+	sys_put_le16(link.rx_len, &value[10]);
+	value[12] = link.mode;
+	value[13] = link.refusals;
+}
+
+static ssize_t read_link(struct bt_conn *conn,
+			 const struct bt_gatt_attr *attr,
+			 void *buf,
+			 uint16_t len, uint16_t offset)
+{
+	u_int8_t value[MELTY_LINK_LEN];
+
+	put_link(value);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+//timer interrupt - stops the motors right here rather than waiting for the control loop to notice
+static void failsafe_expired(struct k_timer *timer)
+{
+	atomic_set(&control_valid, 0);
+	motors_disarm();
+
+#if defined(CONFIG_MELTY_FAILSAFE_BENCHMARK)
+	failsafe_latency_cycles = k_cycle_get_32() - last_control_cycles;
+	k_work_submit(&failsafe_report_work);
+#endif
+}
+
+#if defined(CONFIG_MELTY_FAILSAFE_BENCHMARK)
+static void report_failsafe(struct k_work *work)
+{
+	printk("Failsafe: motors safe %u us after last control write\n",
+	       k_cyc_to_us_floor32(failsafe_latency_cycles));
+}
+#endif
+
+bool get_control_valid(void) {
+    return atomic_get(&control_valid) != 0;
+}
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+u_int32_t take_control_write_cycles(void) {
+    return (u_int32_t)atomic_set(&pending_control_cycles, 0);
+}
+
+void get_control_write_counts(u_int32_t *commands, u_int32_t *requests, u_int32_t *lost, u_int32_t *stale) {
+    *commands = control_commands;
+    *requests = control_requests;
+    *lost = control_lost;
+    *stale = control_stale;
+}
+#endif
+
+void reset_control_sequence(void) {
+    k_timer_stop(&failsafe_timer);
+    atomic_set(&control_valid, 0);
+    motors_disarm();
+    have_sequence = false;
+}
+
 void clear_melty_parameters_initialized(void) {
     melty_parameters_initialized = false;
 }
@@ -89,11 +388,11 @@ float get_radius(void) {
     return radius;
 }
 
-
-u_int8_t get_heart_beat(void) {
-    return heart_beat;
+u_int16_t get_radius_raw(void) {
+    return radius_raw;
 }
 
+
 u_int8_t get_translate_direction(void) {
     return translate_direction;
 }
@@ -119,21 +418,250 @@ BT_GATT_PRIMARY_SERVICE(BT_UUID_MELTYBLE),
 			       BT_GATT_CHRC_WRITE,
 			       BT_GATT_PERM_WRITE,
 			       NULL, update_melty_config, NULL),
+	BT_GATT_CHARACTERISTIC(BT_UUID_MELTYBLE_CONTROL,
+			       BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+			       BT_GATT_PERM_WRITE,
+			       NULL, update_melty_config, NULL),
+	BT_GATT_CHARACTERISTIC(BT_UUID_MELTYBLE_ACCEL_CAL,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+			       BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+			       read_accel_cal, write_accel_cal, NULL),
+	BT_GATT_CHARACTERISTIC(BT_UUID_MELTYBLE_BATTERY,
+			       BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ,
+			       read_battery, NULL, NULL),
+	BT_GATT_CHARACTERISTIC(BT_UUID_MELTYBLE_LINK,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_READ, read_link, NULL, NULL),
+	BT_GATT_CCC(melty_link_ccc_cfg_changed,
+		    BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+#if defined(CONFIG_MELTY_TELEMETRY_V2)
+	BT_GATT_CHARACTERISTIC(BT_UUID_MELTYBLE_STATS_V2,
+			       BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(melty_v2_ccc_cfg_changed,
+		    BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+#endif
+	BT_GATT_CHARACTERISTIC(BT_UUID_MELTYBLE_ACCEL_STATS,
+			       BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ,
+			       read_accel_stats, NULL, NULL),
 );
 
+static const struct bt_gatt_attr *find_value_attr(const struct bt_uuid *uuid)
+{
+	return bt_gatt_find_by_uuid(meltyble_svc.attrs, meltyble_svc.attr_count, uuid);
+}
+
 int bt_melty_init(void)
 {
-	//nothing to init / placeholder
+	stats_attr = find_value_attr(BT_UUID_MELTYBLE_STATS);
+	link_attr = find_value_attr(BT_UUID_MELTYBLE_LINK);
+	if (!stats_attr || !link_attr) return -ENOENT;
+
+#if defined(CONFIG_MELTY_TELEMETRY_V2)
+	stats_v2_attr = find_value_attr(BT_UUID_MELTYBLE_STATS_V2);
+	if (!stats_v2_attr) return -ENOENT;
+#endif
+
 	return 0;
 }
 
+#if defined(CONFIG_MELTY_TELEMETRY_DEFERRED)
+#if defined(CONFIG_MELTY_TELEMETRY_V2)
+//as many queued records per notification as the negotiated MTU allows
+static void send_records(struct bt_conn *conn)
+{
+	u_int8_t packet[STATS_V2_MAX_PAYLOAD];
+	u_int32_t per_packet = MIN(stats_v2_records_per_packet(bt_gatt_get_mtu(conn)),
+				   stats_v2_records_per_packet(CONFIG_BT_L2CAP_TX_MTU));
+
+	//nobody listening - drop whatever was queued before they unsubscribed
+	if (!notify_v2_enabled || per_packet == 0) {
+		atomic_set(&records_tail, atomic_get(&records_head));
+		return;
+	}
+
+	while (true) {
+		u_int32_t tail = (u_int32_t)atomic_get(&records_tail);
+		u_int32_t count = MIN((u_int32_t)atomic_get(&records_head) - tail, per_packet);
+
+		if (count == 0) return;
+
+		stats_v2_put_header(packet, count);
+		for (u_int32_t x = 0; x < count; x++) {
+			stats_v2_put_record(&records[(tail + x) & (RECORD_RING_SIZE - 1)],
+				   &packet[STATS_V2_HEADER_SIZE + x * STATS_V2_RECORD_SIZE]);
+		}
+
+		//TX full - records stay queued for the next run
+		if (bt_gatt_notify(conn, stats_v2_attr, packet,
+				   STATS_V2_HEADER_SIZE + count * STATS_V2_RECORD_SIZE) != 0) {
+			return;
+		}
+
+		atomic_set(&records_tail, tail + count);
+	}
+}
+
+static void mtu_exchanged(struct bt_conn *conn, uint8_t err,
+			  struct bt_gatt_exchange_params *params)
+{
+	LOG_DBG("MTU exchange %s, ATT MTU %u", err ? "failed" : "done", bt_gatt_get_mtu(conn));
+}
+#endif
+
+static void schedule_telemetry(void)
+{
+	//no more than one send per connection event (or the configured interval if longer)
+	u_int32_t interval_ms = MAX(CONFIG_MELTY_TELEMETRY_INTERVAL_MS, conn_interval_ms);
+	int32_t delay_ms = (int32_t)(last_sent_ms + interval_ms - k_uptime_get_32());
+
+	//already scheduled - the pending send just picks up the latest data
+	k_work_schedule(&telemetry_work, K_MSEC(MAX(delay_ms, 0)));
+}
+
+static void send_telemetry(struct k_work *work)
+{
+	u_int8_t melty_stats[3];
+	struct bt_conn *conn;
+
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+	conn = telemetry_conn ? bt_conn_ref(telemetry_conn) : NULL;
+	k_spin_unlock(&conn_lock, key);
+
+	if (!conn) return;
+
+	last_sent_ms = k_uptime_get_32();
+
+	key = k_spin_lock(&stats_lock);
+	memcpy(melty_stats, pending_stats, sizeof(melty_stats));
+	k_spin_unlock(&stats_lock, key);
+
+	//system workqueue - the host won't block here for a buffer, if TX is full this one is
+	//dropped and the next rotation's stats go out instead
+	bt_send_melty_stats(melty_stats);
+
+#if defined(CONFIG_MELTY_TELEMETRY_V2)
+	send_records(conn);
+
+	if (atomic_get(&records_head) != atomic_get(&records_tail)) schedule_telemetry();
+#endif
+
+	bt_conn_unref(conn);
+}
+
+void bt_queue_melty_stats(const u_int8_t melty_stats[3])
+{
+	if (!notify_enabled) {
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	memcpy(pending_stats, melty_stats, sizeof(pending_stats));
+	k_spin_unlock(&stats_lock, key);
+
+	schedule_telemetry();
+}
+
+#if defined(CONFIG_MELTY_TELEMETRY_V2)
+void bt_queue_melty_record(const struct melty_telemetry_record *record)
+{
+	if (!notify_v2_enabled) {
+		return;
+	}
+
+	u_int32_t head = (u_int32_t)atomic_get(&records_head);
+
+	//full (TX backed up) - newest is dropped, the client sees the gap in sequence
+	if (head - (u_int32_t)atomic_get(&records_tail) >= RECORD_RING_SIZE) {
+		return;
+	}
+
+	records[head & (RECORD_RING_SIZE - 1)] = *record;
+	atomic_set(&records_head, head + 1);
+
+	schedule_telemetry();
+}
+#endif
+
+static void set_conn_interval(u_int16_t interval)
+{
+	//1.25 ms units, rounded up
+	conn_interval_ms = (interval * 5 + 3) / 4;
+}
+
+static void telemetry_connected(struct bt_conn *conn, uint8_t err)
+{
+	struct bt_conn_info info;
+
+	if (err) return;
+
+	if (bt_conn_get_info(conn, &info) == 0) {
+		set_conn_interval(info.le.interval);
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+	telemetry_conn = bt_conn_ref(conn);
+	k_spin_unlock(&conn_lock, key);
+
+#if defined(CONFIG_MELTY_TELEMETRY_V2)
+	//room for batched records - either may be refused, records per notification follow the MTU we end up with
+	mtu_exchange_params.func = mtu_exchanged;
+	bt_gatt_exchange_mtu(conn, &mtu_exchange_params);
+#if !defined(CONFIG_MELTY_CONN_NEGOTIATION)
+	//otherwise conn_params asks (and re-asks) for it
+	bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+#endif
+#endif
+}
+
+static void telemetry_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	set_conn_interval(0);
+
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+	if (telemetry_conn) {
+		bt_conn_unref(telemetry_conn);
+		telemetry_conn = NULL;
+	}
+	k_spin_unlock(&conn_lock, key);
+}
+
+static void telemetry_le_param_updated(struct bt_conn *conn, uint16_t interval,
+				       uint16_t latency, uint16_t timeout)
+{
+	set_conn_interval(interval);
+}
+
+BT_CONN_CB_DEFINE(telemetry_conn_callbacks) = {
+	.connected        = telemetry_connected,
+	.disconnected     = telemetry_disconnected,
+	.le_param_updated = telemetry_le_param_updated,
+};
+#endif
+
 int bt_send_melty_stats(u_int8_t melty_stats[3])
 {
 	if (!notify_enabled) {
 		return -EACCES;
 	}
 
-	return bt_gatt_notify(NULL, &meltyble_svc.attrs[2],
+	return bt_gatt_notify(NULL, stats_attr,
 			      melty_stats,
 			      3);
 }
+
+//system workqueue (conn_params) - whenever the connection parameters, PHY or data length change
+int bt_send_melty_link(void)
+{
+	u_int8_t value[MELTY_LINK_LEN];
+
+	if (!notify_link_enabled) {
+		return -EACCES;
+	}
+
+	put_link(value);
+
+	return bt_gatt_notify(NULL, link_attr, value, sizeof(value));
+}
@@ -32,7 +32,7 @@ extern "C" {
 	BT_UUID_128_ENCODE(0x00001525, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
 
 //BT_UUID_MELTYBLE_CONFIG
-//7 bytes of data sent from BLE client to configure melty bot
+//10 bytes of data sent from BLE client to configure melty bot
 //2-byte (unsigned) radius value is provided as radius in centimeters * 1000
 // Dynamic adjustment of radius is used to control steering
 // [0] Radius Least Signicant Byte
@@ -41,8 +41,112 @@ extern "C" {
 // [3] Throttle 0-100 value corresponding % of each rotation wheel(s) are powered
 	//0 = off, 100 = fully on (no translation)
 // [4] Translate direction (idle, forward or reverse)
-// [5] Heartbeat value
-// [6] Reserved 
+// [5] Reserved (was heartbeat)
+// [6..9] Sequence number (unsigned, little endian) - must increase with every write
+	//writes that don't (duplicated, reordered, replayed) are ignored and don't feed the failsafe
+	//first write after connecting may start anywhere except 0, which is never accepted
+	//motors are stopped CONFIG_MELTY_CONTROL_TIMEOUT_MS after the last accepted write
+
+#define MELTY_CONFIG_LEN 10
+
+/** @brief Melty Control Characteristic UUID. */
+#define BT_UUID_MELTYBLE_CONTROL_VAL \
+	BT_UUID_128_ENCODE(0x00001529, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+
+//BT_UUID_MELTYBLE_CONTROL
+//Same 10 bytes as BT_UUID_MELTYBLE_CONFIG, written without response (ATT write command)
+//No acknowledgement to wait on, so a client can send every connection event - newest sequence
+//number wins, anything older arriving after it is dropped. Gaps in the sequence are counted as lost
+
+/** @brief Melty Accel Calibration Characteristic UUID. */
+#define BT_UUID_MELTYBLE_ACCEL_CAL_VAL \
+	BT_UUID_128_ENCODE(0x00001526, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+
+//BT_UUID_MELTYBLE_ACCEL_CAL
+//Write 1 byte to control zero g calibration (bot must sit still, flat, for ~1 second)
+// [0] ACCEL_CAL_CAPTURE or ACCEL_CAL_CLEAR
+//Read 7 bytes of calibration status
+// [0] State - 0 = none, 1 = capturing, 2 = valid, 3 = last capture failed (bot moved)
+// [1..2] X offset (signed, little endian) in 3.0625 mg units
+// [3..4] Y offset
+// [5..6] Z offset
+
+/** @brief Melty Battery Characteristic UUID. */
+#define BT_UUID_MELTYBLE_BATTERY_VAL \
+	BT_UUID_128_ENCODE(0x00001527, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+
+//BT_UUID_MELTYBLE_BATTERY
+//Read 11 bytes of load synchronous battery measurement (all unsigned, little endian)
+// [0] Valid flags - BATTERY_*_VALID, a field is 0 until its flag is set
+// [1..2] Loaded voltage (a motor on) in mV
+// [3..4] Unloaded voltage (both motors off) in mV
+// [5..6] Open circuit voltage in mV
+// [7..8] Sag per motor switched on in mV
+// [9..10] Pack internal resistance in mOhm
+
+/** @brief Melty Stats v2 Characteristic UUID. */
+#define BT_UUID_MELTYBLE_STATS_V2_VAL \
+	BT_UUID_128_ENCODE(0x00001528, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+
+//BT_UUID_MELTYBLE_STATS_V2 (CONFIG_MELTY_TELEMETRY_V2)
+//Notify only - per rotation records batched into one notification, as many as the ATT MTU
+//allows (1 at the default 23, 13 at 247) - firmware asks for a larger MTU and data length on connect
+// [0] Version (STATS_V2_VERSION)
+// [1] Record count
+// then 18 byte records (little endian):
+// [0..1] Sequence - rotation count, gaps mean records were dropped
+// [2..4] Rotation interval in us (unsigned, 24 bit - saturates at 16.7 s)
+// [5..7] X axis accel (signed, 24 bit) in 3.0625 mg units, latency compensated
+// [8..9] Battery voltage in mV (filtered, as on the stats characteristic)
+// [10..11] Loaded battery voltage in mV - 0 if not measured
+// [12..13] Unloaded battery voltage in mV - 0 if not measured
+// [14..15] Loop jitter in us - how far this rotation's control pass came from the previous interval (65535 = out of range)
+// [16..17] Spin rate in rpm per second (signed) - spin up positive, from tangential accel
+
+//version 3 added spin rate, 4 packed interval and accel into 24 bits to fit the default MTU
+#define STATS_V2_VERSION 4
+
+/** @brief Melty Link Characteristic UUID. */
+#define BT_UUID_MELTYBLE_LINK_VAL \
+	BT_UUID_128_ENCODE(0x0000152a, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+
+//BT_UUID_MELTYBLE_LINK
+//Read / notify (on every change) 14 bytes describing the connection as it currently runs (little endian)
+// [0..1] Connection interval in 1.25 ms units
+// [2..3] Peripheral latency in connection events
+// [4..5] Supervision timeout in 10 ms units
+// [6] TX PHY (1 = 1M, 2 = 2M, 4 = coded, 0 = unknown)
+// [7] RX PHY
+// [8..9] TX data length - max LL payload octets (0 = unknown)
+// [10..11] RX data length
+// [12] Mode the bot is asking for - CONN_MODE_CONTROL or CONN_MODE_POWER_SAVE (throttle 0)
+// [13] Requests the central refused or ignored this connection (saturates at 255)
+
+#define MELTY_LINK_LEN 14
+
+/** @brief Melty Accel Stats Characteristic UUID. */
+#define BT_UUID_MELTYBLE_ACCEL_STATS_VAL \
+	BT_UUID_128_ENCODE(0x0000152b, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+
+//BT_UUID_MELTYBLE_ACCEL_STATS
+//Read 22 bytes of accelerometer sampling counters (all unsigned, little endian) - counts run from boot
+// [0..1] Sample rate in Hz - samples read over the last second
+// [2..5] Samples read
+// [6..9] Dropped samples - sensor overruns, a sample was replaced before it was read
+// [10..13] Missed data ready interrupts
+// [14..17] Impacts - bursts of samples rejected as hits
+// [18..21] Rejected samples - kept away from the rpm estimate
+
+#define MELTY_ACCEL_STATS_LEN 22
+
+#define BATTERY_LOADED_VALID		0x01
+#define BATTERY_UNLOADED_VALID		0x02
+#define BATTERY_OPEN_CIRCUIT_VALID	0x04
+#define BATTERY_SAG_VALID			0x08
+#define BATTERY_RESISTANCE_VALID	0x10
+
+#define ACCEL_CAL_CLEAR 0
+#define ACCEL_CAL_CAPTURE 1
 
 #define TRANSLATE_IDLE 0
 #define TRANSLATE_FORWARD 1
@@ -51,21 +155,62 @@ extern "C" {
 #define BT_UUID_MELTYBLE           	BT_UUID_DECLARE_128(BT_UUID_MELTYBLE_VAL)
 #define BT_UUID_MELTYBLE_STATS    	BT_UUID_DECLARE_128(BT_UUID_MELTYBLE_STATS_VAL)
 #define BT_UUID_MELTYBLE_CONFIG		BT_UUID_DECLARE_128(BT_UUID_MELTYBLE_CONFIG_VAL)
+#define BT_UUID_MELTYBLE_CONTROL	BT_UUID_DECLARE_128(BT_UUID_MELTYBLE_CONTROL_VAL)
+#define BT_UUID_MELTYBLE_ACCEL_CAL	BT_UUID_DECLARE_128(BT_UUID_MELTYBLE_ACCEL_CAL_VAL)
+#define BT_UUID_MELTYBLE_BATTERY	BT_UUID_DECLARE_128(BT_UUID_MELTYBLE_BATTERY_VAL)
+#define BT_UUID_MELTYBLE_STATS_V2	BT_UUID_DECLARE_128(BT_UUID_MELTYBLE_STATS_V2_VAL)
+#define BT_UUID_MELTYBLE_LINK		BT_UUID_DECLARE_128(BT_UUID_MELTYBLE_LINK_VAL)
+#define BT_UUID_MELTYBLE_ACCEL_STATS	BT_UUID_DECLARE_128(BT_UUID_MELTYBLE_ACCEL_STATS_VAL)
+
+struct melty_telemetry_record {
+	u_int16_t sequence;
+	u_int32_t rotation_interval_us;
+	int32_t accel_raw;
+	u_int16_t battery_mv;
+	u_int16_t loaded_mv;
+	u_int16_t unloaded_mv;
+	u_int16_t loop_jitter_us;
+	int16_t spin_rate_rpm_s;
+};
 
 
 int bt_melty_init(void);
 
 int bt_send_melty_stats(u_int8_t melty_stats[3]);
 
+//notifies the current link characteristic value
+int bt_send_melty_link(void);
+
+//latest wins - sent from the system workqueue at most once per connection interval
+//(CONFIG_MELTY_TELEMETRY_INTERVAL_MS if longer), never blocks on the host
+void bt_queue_melty_stats(const u_int8_t melty_stats[3]);
+
+//one per rotation - queued and batched into stats v2 notifications, never blocks
+void bt_queue_melty_record(const struct melty_telemetry_record *record);
+
 float get_radius(void);
 
+//radius in centimeters * 1000 as sent by client
+u_int16_t get_radius_raw(void);
+
 bool get_melty_parameters_initialized(void);
 
 void clear_melty_parameters_initialized(void);
 
 u_int8_t get_translate_direction(void);
 
-u_int8_t get_heart_beat(void);
+//a control write was accepted within CONFIG_MELTY_CONTROL_TIMEOUT_MS
+bool get_control_valid(void);
+
+//stops the failsafe timer and the motors and forgets the sequence number (on disconnect)
+void reset_control_sequence(void);
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+//accept time (k_cycle_get_32) of the newest control write since the last call - 0 if none
+u_int32_t take_control_write_cycles(void);
+
+void get_control_write_counts(u_int32_t *commands, u_int32_t *requests, u_int32_t *lost, u_int32_t *stale);
+#endif
 
 u_int8_t get_throttle(void);
 
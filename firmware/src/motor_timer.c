@@ -0,0 +1,513 @@
+#include <zephyr/types.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+#include <nrfx_timer.h>
+#include <nrfx_gpiote.h>
+#include <nrfx_ppi.h>
+#include <hal/nrf_timer.h>
+
+#include "motor_timer.h"
+
+//TIMER0 is reserved by MPSL / SoftDevice Controller
+//TIMER3 + TIMER4 are the only instances with 6 compare channels
+#define ROTATION_TIMER_INSTANCE	3
+#define LED_TIMER_INSTANCE		4
+
+//priority 0 belongs to the radio - keep just under it so reloads are not held off by BLE host work
+#define MOTOR_TIMER_IRQ_PRIORITY	1
+
+//rotation timer channels
+#define MOTOR1_ON_CC		NRF_TIMER_CC_CHANNEL0
+#define MOTOR1_OFF_CC		NRF_TIMER_CC_CHANNEL1
+#define MOTOR2_ON_CC		NRF_TIMER_CC_CHANNEL2
+#define MOTOR2_OFF_CC		NRF_TIMER_CC_CHANNEL3
+#define CAPTURE_CC			NRF_TIMER_CC_CHANNEL4
+#define ROTATION_END_CC		NRF_TIMER_CC_CHANNEL5
+
+//LED timer channels (cleared in lock step with rotation timer via PPI)
+#define LED_ON_CC			NRF_TIMER_CC_CHANNEL0
+#define LED_OFF_CC			NRF_TIMER_CC_CHANNEL1
+#define EDGE_CAPTURE_CC		NRF_TIMER_CC_CHANNEL2
+
+//shortest rotation the end-of-rotation compare will accept
+#define MIN_ROTATION_INTERVAL_US	100
+
+enum {
+	MOTOR1_PIN_INDEX,
+	MOTOR2_PIN_INDEX,
+	LED_PIN_INDEX,
+	PIN_COUNT
+};
+
+static const nrfx_timer_t rotation_timer = NRFX_TIMER_INSTANCE(ROTATION_TIMER_INSTANCE);
+static const nrfx_timer_t led_timer = NRFX_TIMER_INSTANCE(LED_TIMER_INSTANCE);
+
+static u_int32_t pins[PIN_COUNT];
+
+//pin level at the end of the currently loaded rotation
+static bool end_level[PIN_COUNT];
+
+static struct motor_timer_edges active_edges;
+static struct motor_timer_edges queued_edges;
+static atomic_t edges_queued;
+static struct k_sem queue_free;
+
+static bool running = false;
+//cleared by motor_timer_disarm - only ever changed / checked with interrupts locked
+static bool armed = false;
+
+static struct motor_timer_stats stats;
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+//latency + 1 of the newest tagged rotation loaded - 0 when there is none
+static atomic_t control_latency_us;
+#endif
+
+#if defined(CONFIG_MELTY_EDGE_CAPTURE_PIN)
+//last motor 1 edge the loaded rotation will switch through PPI, and when it was loaded
+static u_int32_t capture_expected = MOTOR_TIMER_EDGE_NEVER;
+static u_int32_t capture_loaded_at;
+#endif
+
+//level of a pin at time t into the rotation - carry_level is the level the rotation started with
+static bool level_at(u_int32_t on, u_int32_t off, u_int32_t t, bool carry_level, u_int32_t *last_edge)
+{
+	bool on_passed = on <= t;
+	bool off_passed = off <= t;
+
+	if (on_passed && (!off_passed || on >= off)) {
+		*last_edge = on;
+		return true;
+	}
+
+	if (off_passed) {
+		*last_edge = off;
+		return false;
+	}
+
+	*last_edge = 0;
+	return carry_level;
+}
+
+static void force_pin_level(int index, bool level)
+{
+	if (level) {
+		nrfx_gpiote_set_task_trigger(pins[index]);
+	} else {
+		nrfx_gpiote_clr_task_trigger(pins[index]);
+	}
+}
+
+//edges that already went by before their compare value was written are applied here
+static void apply_passed_edges(int index, u_int32_t on, u_int32_t off, u_int32_t now, u_int32_t rotation_interval_us)
+{
+	u_int32_t last_edge;
+	bool carry_level = end_level[index];
+	bool level = level_at(on, off, now, carry_level, &last_edge);
+
+	force_pin_level(index, level);
+
+	if (level != carry_level) {
+		stats.late_edges++;
+		if (now - last_edge > stats.max_late_us) stats.max_late_us = now - last_edge;
+	}
+
+	end_level[index] = level_at(on, off, rotation_interval_us, carry_level, &last_edge);
+}
+
+#if defined(CONFIG_MELTY_EDGE_CAPTURE_PIN)
+//called once the passed edges have been forced - anything captured before this is not a PPI edge
+static void arm_edge_capture(const struct motor_timer_edges *edges, u_int32_t rotation_interval_us)
+{
+	const u_int32_t motor1_edges[] = { edges->motor1_on, edges->motor1_off };
+	//the software edges just forced may land in the capture a tick after this
+	u_int32_t loaded_at = nrfx_timer_capture(&rotation_timer, CAPTURE_CC) + 1;
+	u_int32_t expected = MOTOR_TIMER_EDGE_NEVER;
+
+	for (int x = 0; x < ARRAY_SIZE(motor1_edges); x++) {
+		u_int32_t edge = motor1_edges[x];
+
+		if (edge > loaded_at && edge < rotation_interval_us &&
+		    (expected == MOTOR_TIMER_EDGE_NEVER || edge > expected)) {
+			expected = edge;
+		}
+	}
+
+	capture_expected = expected;
+	capture_loaded_at = loaded_at;
+}
+
+//called at the end of rotation, before the next one is loaded
+static void record_edge_capture(void)
+{
+	if (capture_expected == MOTOR_TIMER_EDGE_NEVER) return;
+
+	u_int32_t captured = nrf_timer_cc_get(led_timer.p_reg, EDGE_CAPTURE_CC);
+	u_int32_t now = nrfx_timer_capture(&rotation_timer, CAPTURE_CC);
+
+	//already overwritten by an edge of the rotation that just started - nothing to compare
+	if (captured <= now) return;
+
+	if (captured < capture_loaded_at) {
+		stats.missed_edges++;
+		return;
+	}
+
+	int32_t error_us = (int32_t)(captured - capture_expected);
+
+	if (stats.timed_edges == 0 || error_us < stats.edge_error_min_us) stats.edge_error_min_us = error_us;
+	if (stats.timed_edges == 0 || error_us > stats.edge_error_max_us) stats.edge_error_max_us = error_us;
+	stats.edge_error_total_us += error_us;
+	stats.timed_edges++;
+}
+#endif
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+//called as the tagged rotation is loaded - its first motor edge is switched by PPI later in the rotation,
+//or was forced just now if it had already passed
+static void record_control_latency(const struct motor_timer_edges *edges, u_int32_t now)
+{
+	const u_int32_t motor_edges[] = { edges->motor1_on, edges->motor1_off, edges->motor2_on, edges->motor2_off };
+	u_int32_t first_edge = MOTOR_TIMER_EDGE_NEVER;
+
+	for (int x = 0; x < ARRAY_SIZE(motor_edges); x++) {
+		if (motor_edges[x] < first_edge) first_edge = motor_edges[x];
+	}
+
+	u_int32_t latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - edges->control_write_cycles);
+	if (first_edge != MOTOR_TIMER_EDGE_NEVER && first_edge > now) latency_us += first_edge - now;
+
+	atomic_set(&control_latency_us, (atomic_val_t)latency_us + 1);
+}
+#endif
+
+static void load_edges(const struct motor_timer_edges *edges)
+{
+	NRF_TIMER_Type *rotation_reg = rotation_timer.p_reg;
+	NRF_TIMER_Type *led_reg = led_timer.p_reg;
+
+	u_int32_t rotation_interval_us = edges->rotation_interval_us;
+	if (rotation_interval_us < MIN_ROTATION_INTERVAL_US) rotation_interval_us = MIN_ROTATION_INTERVAL_US;
+
+	nrf_timer_cc_set(rotation_reg, ROTATION_END_CC, rotation_interval_us);
+	nrf_timer_cc_set(rotation_reg, MOTOR1_ON_CC, edges->motor1_on);
+	nrf_timer_cc_set(rotation_reg, MOTOR1_OFF_CC, edges->motor1_off);
+	nrf_timer_cc_set(rotation_reg, MOTOR2_ON_CC, edges->motor2_on);
+	nrf_timer_cc_set(rotation_reg, MOTOR2_OFF_CC, edges->motor2_off);
+	nrf_timer_cc_set(led_reg, LED_ON_CC, edges->led_on);
+	nrf_timer_cc_set(led_reg, LED_OFF_CC, edges->led_off);
+
+	//a compare of 0 never fires (counter is cleared, not incremented, to 0) - those edges always land here
+	u_int32_t now = nrfx_timer_capture(&rotation_timer, CAPTURE_CC);
+	if (now > stats.max_reload_us) stats.max_reload_us = now;
+
+	apply_passed_edges(MOTOR1_PIN_INDEX, edges->motor1_on, edges->motor1_off, now, rotation_interval_us);
+	apply_passed_edges(MOTOR2_PIN_INDEX, edges->motor2_on, edges->motor2_off, now, rotation_interval_us);
+	apply_passed_edges(LED_PIN_INDEX, edges->led_on, edges->led_off, now, rotation_interval_us);
+
+#if defined(CONFIG_MELTY_EDGE_CAPTURE_PIN)
+	arm_edge_capture(edges, rotation_interval_us);
+#endif
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+	if (edges->control_write_cycles != 0) record_control_latency(edges, now);
+#endif
+}
+
+static void rotation_timer_handler(nrf_timer_event_t event_type, void *context)
+{
+	if (event_type != NRF_TIMER_EVENT_COMPARE5) return;
+
+	stats.rotations++;
+
+#if defined(CONFIG_MELTY_EDGE_CAPTURE_PIN)
+	record_edge_capture();
+#endif
+
+	if (atomic_cas(&edges_queued, 1, 0)) {
+		active_edges = queued_edges;
+		load_edges(&active_edges);
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+		//repeats of this rotation after an underrun don't carry the write again
+		active_edges.control_write_cycles = 0;
+#endif
+		k_sem_give(&queue_free);
+	} else {
+		//nothing new from control loop - repeat previous rotation
+		stats.underruns++;
+		load_edges(&active_edges);
+	}
+}
+
+static void led_timer_handler(nrf_timer_event_t event_type, void *context)
+{
+	//no interrupts enabled on LED timer
+}
+
+static int init_gpiote_pin(u_int32_t pin)
+{
+	uint8_t channel;
+
+	if (nrfx_gpiote_channel_alloc(&channel) != NRFX_SUCCESS) {
+		return -EBUSY;
+	}
+
+	nrfx_gpiote_output_config_t output_config = NRFX_GPIOTE_DEFAULT_OUTPUT_CONFIG;
+	nrfx_gpiote_task_config_t task_config = {
+		.task_ch = channel,
+		.polarity = NRF_GPIOTE_POLARITY_TOGGLE,
+		.init_val = NRF_GPIOTE_INITIAL_VALUE_LOW,
+	};
+
+	if (nrfx_gpiote_output_configure(pin, &output_config, &task_config) != NRFX_SUCCESS) {
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int connect_ppi(u_int32_t event_address, u_int32_t task_address)
+{
+	nrf_ppi_channel_t channel;
+
+	if (nrfx_ppi_channel_alloc(&channel) != NRFX_SUCCESS) {
+		return -EBUSY;
+	}
+
+	nrfx_ppi_channel_assign(channel, event_address, task_address);
+	nrfx_ppi_channel_enable(channel);
+
+	return 0;
+}
+
+#if defined(CONFIG_MELTY_EDGE_CAPTURE_PIN)
+//capture pin edges (either way) into the LED timer - same time base as the rotation timer
+static int init_edge_capture(u_int32_t pin)
+{
+	uint8_t channel;
+
+	if (nrfx_gpiote_channel_alloc(&channel) != NRFX_SUCCESS) {
+		return -EBUSY;
+	}
+
+	nrfx_gpiote_input_config_t input_config = {
+		.pull = NRF_GPIO_PIN_NOPULL,
+	};
+	nrfx_gpiote_trigger_config_t trigger_config = {
+		.trigger = NRFX_GPIOTE_TRIGGER_TOGGLE,
+		.p_in_channel = &channel,
+	};
+
+	if (nrfx_gpiote_input_configure(pin, &input_config, &trigger_config, NULL) != NRFX_SUCCESS) {
+		return -EIO;
+	}
+
+	nrfx_gpiote_trigger_enable(pin, false);
+
+	return connect_ppi(nrfx_gpiote_in_event_addr_get(pin),
+			   nrfx_timer_capture_task_address_get(&led_timer, EDGE_CAPTURE_CC));
+}
+#endif
+
+static int init_timer(const nrfx_timer_t *timer, nrfx_timer_event_handler_t handler)
+{
+	nrfx_timer_config_t timer_config = NRFX_TIMER_DEFAULT_CONFIG;
+	timer_config.frequency = NRF_TIMER_FREQ_1MHz;	//1 tick = 1 us (same units as melty parameters)
+	timer_config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+	timer_config.interrupt_priority = MOTOR_TIMER_IRQ_PRIORITY;
+
+	if (nrfx_timer_init(timer, &timer_config, handler) != NRFX_SUCCESS) {
+		return -EIO;
+	}
+
+	return 0;
+}
+
+int motor_timer_init(u_int32_t motor_pin1, u_int32_t motor_pin2, u_int32_t led_pin)
+{
+	int err;
+
+	pins[MOTOR1_PIN_INDEX] = motor_pin1;
+	pins[MOTOR2_PIN_INDEX] = motor_pin2;
+	pins[LED_PIN_INDEX] = led_pin;
+
+	k_sem_init(&queue_free, 1, 1);
+	atomic_set(&edges_queued, 0);
+
+	IRQ_CONNECT(DT_IRQN(DT_NODELABEL(timer3)), MOTOR_TIMER_IRQ_PRIORITY,
+		    nrfx_isr, nrfx_timer_3_irq_handler, 0);
+
+	err = init_timer(&rotation_timer, rotation_timer_handler);
+	if (err) return err;
+
+	err = init_timer(&led_timer, led_timer_handler);
+	if (err) return err;
+
+	for (int x = 0; x < PIN_COUNT; x++) {
+		err = init_gpiote_pin(pins[x]);
+		if (err) return err;
+	}
+
+	//end of rotation clears rotation timer (short) and LED timer (PPI) in the same clock cycle
+	nrf_timer_shorts_enable(rotation_timer.p_reg, NRF_TIMER_SHORT_COMPARE5_CLEAR_MASK);
+	nrf_timer_int_enable(rotation_timer.p_reg, NRF_TIMER_INT_COMPARE5_MASK);
+
+	u_int32_t rotation_end_event = nrfx_timer_compare_event_address_get(&rotation_timer, ROTATION_END_CC);
+	err = connect_ppi(rotation_end_event, nrfx_timer_task_address_get(&led_timer, NRF_TIMER_TASK_CLEAR));
+	if (err) return err;
+
+	const struct {
+		const nrfx_timer_t *timer;
+		nrf_timer_cc_channel_t cc;
+		int pin_index;
+		bool set;
+	} edge_routes[] = {
+		{ &rotation_timer, MOTOR1_ON_CC, MOTOR1_PIN_INDEX, true },
+		{ &rotation_timer, MOTOR1_OFF_CC, MOTOR1_PIN_INDEX, false },
+		{ &rotation_timer, MOTOR2_ON_CC, MOTOR2_PIN_INDEX, true },
+		{ &rotation_timer, MOTOR2_OFF_CC, MOTOR2_PIN_INDEX, false },
+		{ &led_timer, LED_ON_CC, LED_PIN_INDEX, true },
+		{ &led_timer, LED_OFF_CC, LED_PIN_INDEX, false },
+	};
+
+	for (int x = 0; x < ARRAY_SIZE(edge_routes); x++) {
+		u_int32_t pin = pins[edge_routes[x].pin_index];
+		u_int32_t task_address = edge_routes[x].set ? nrfx_gpiote_set_task_addr_get(pin) :
+							      nrfx_gpiote_clr_task_addr_get(pin);
+
+		err = connect_ppi(nrfx_timer_compare_event_address_get(edge_routes[x].timer, edge_routes[x].cc),
+				  task_address);
+		if (err) return err;
+	}
+
+#if defined(CONFIG_MELTY_EDGE_CAPTURE_PIN)
+	err = init_edge_capture(CONFIG_MELTY_EDGE_CAPTURE_PIN);
+	if (err) return err;
+#endif
+
+	return 0;
+}
+
+//called with interrupts locked
+static void start_timers(const struct motor_timer_edges *edges)
+{
+	nrfx_timer_clear(&rotation_timer);
+	nrfx_timer_clear(&led_timer);
+
+	for (int x = 0; x < PIN_COUNT; x++) {
+		end_level[x] = false;
+		nrfx_gpiote_out_task_enable(pins[x]);
+	}
+
+	active_edges = *edges;
+	load_edges(&active_edges);
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+	active_edges.control_write_cycles = 0;
+#endif
+
+	nrfx_timer_enable(&led_timer);
+	nrfx_timer_enable(&rotation_timer);
+
+	running = true;
+}
+
+int motor_timer_queue_rotation(const struct motor_timer_edges *edges, k_timeout_t timeout)
+{
+	unsigned int key = irq_lock();
+
+	if (!armed) {
+		irq_unlock(key);
+		return -ECANCELED;
+	}
+
+	if (!running) {
+		start_timers(edges);
+		irq_unlock(key);
+		return 0;
+	}
+
+	irq_unlock(key);
+
+	if (k_sem_take(&queue_free, timeout) != 0) {
+		return -EAGAIN;
+	}
+
+	key = irq_lock();
+
+	//disarmed while waiting - motor_timer_stop gave the slot, leave it free for after motor_timer_arm
+	if (!armed) {
+		irq_unlock(key);
+		k_sem_give(&queue_free);
+		return -ECANCELED;
+	}
+
+	queued_edges = *edges;
+	atomic_set(&edges_queued, 1);
+
+	irq_unlock(key);
+
+	return 0;
+}
+
+void motor_timer_stop(void)
+{
+	unsigned int key = irq_lock();
+
+	nrfx_timer_disable(&rotation_timer);
+	nrfx_timer_disable(&led_timer);
+
+	for (int x = 0; x < PIN_COUNT; x++) {
+		nrfx_gpiote_clr_task_trigger(pins[x]);
+		nrfx_gpiote_out_task_disable(pins[x]);
+		end_level[x] = false;
+	}
+
+	atomic_set(&edges_queued, 0);
+	k_sem_give(&queue_free);
+	running = false;
+
+	irq_unlock(key);
+}
+
+void motor_timer_disarm(void)
+{
+	unsigned int key = irq_lock();
+
+	armed = false;
+	motor_timer_stop();
+
+	irq_unlock(key);
+}
+
+void motor_timer_arm(void)
+{
+	unsigned int key = irq_lock();
+	armed = true;
+	irq_unlock(key);
+}
+
+bool motor_timer_running(void)
+{
+	return running;
+}
+
+void motor_timer_get_stats(struct motor_timer_stats *stats_out)
+{
+	unsigned int key = irq_lock();
+	*stats_out = stats;
+	irq_unlock(key);
+}
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+bool motor_timer_take_control_latency(u_int32_t *latency_us)
+{
+	atomic_val_t value = atomic_set(&control_latency_us, 0);
+
+	if (value == 0) return false;
+
+	*latency_us = (u_int32_t)(value - 1);
+	return true;
+}
+#endif
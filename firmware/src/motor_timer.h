@@ -0,0 +1,72 @@
+#ifndef MOTOR_TIMER_H_
+
+#define MOTOR_TIMER_H_
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+
+//Hardware timed motor / LED edge engine
+//Each rotation's edges are loaded into TIMER compare channels and drive the pins
+//through PPI -> GPIOTE SET/CLR tasks - the CPU only queues the next rotation
+
+//compare value that is never reached (timer is cleared at end of each rotation)
+#define MOTOR_TIMER_EDGE_NEVER	UINT32_MAX
+
+//on / off times (us from start of rotation) for each pin
+//a window that wraps past the end of the rotation simply has off < on
+//always on: on = 0, off = MOTOR_TIMER_EDGE_NEVER
+//always off: on = MOTOR_TIMER_EDGE_NEVER, off = 0
+struct motor_timer_edges {
+	u_int32_t rotation_interval_us;
+	u_int32_t motor1_on;
+	u_int32_t motor1_off;
+	u_int32_t motor2_on;
+	u_int32_t motor2_off;
+	u_int32_t led_on;
+	u_int32_t led_off;
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+	u_int32_t control_write_cycles;	//accept time (k_cycle_get_32) of the control write these edges first carry - 0 if none
+#endif
+};
+
+struct motor_timer_stats {
+	u_int32_t rotations;
+	u_int32_t underruns;		//rotation boundary reached with nothing queued (previous edges repeated)
+	u_int32_t late_edges;		//edges that had already passed when reloaded (applied in software)
+	u_int32_t max_late_us;
+	u_int32_t max_reload_us;	//worst case time from rotation boundary to compare values loaded
+	//motor 1 edges captured through CONFIG_MELTY_EDGE_CAPTURE_PIN against their scheduled time
+	u_int32_t timed_edges;
+	u_int32_t missed_edges;		//scheduled edge never captured
+	int32_t edge_error_total_us;
+	int32_t edge_error_min_us;
+	int32_t edge_error_max_us;
+};
+
+int motor_timer_init(u_int32_t motor_pin1, u_int32_t motor_pin2, u_int32_t led_pin);
+
+//queues edges for the next rotation - starts the timer if not already running
+//blocks until the previously queued rotation has been picked up by hardware
+//-ECANCELED while disarmed (nothing queued or started)
+int motor_timer_queue_rotation(const struct motor_timer_edges *edges, k_timeout_t timeout);
+
+//stops timer, forces all pins low and returns them to GPIO control
+void motor_timer_stop(void);
+
+//motor_timer_stop, and rotations are refused until motor_timer_arm - callable from interrupts
+//(failsafe), a queue call racing it either completes first and is stopped or is refused
+void motor_timer_disarm(void);
+
+void motor_timer_arm(void);
+
+bool motor_timer_running(void);
+
+void motor_timer_get_stats(struct motor_timer_stats *stats);
+
+#if defined(CONFIG_MELTY_CONTROL_LATENCY_BENCHMARK)
+//control write accepted -> first motor edge of the rotation carrying it, newest since the last call
+//false if no tagged rotation has been loaded since
+bool motor_timer_take_control_latency(u_int32_t *latency_us);
+#endif
+
+#endif
@@ -0,0 +1,188 @@
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <math.h>
+
+#include "phase_sync.h"
+
+#define POINTS					CONFIG_MELTY_ACCEL_PHASE_SYNC_POINTS
+#define POINT_ANGLE				(2.0f * (float)M_PI / POINTS)
+
+//samples further apart than this restart the window
+#define MAX_SAMPLE_GAP_MS		100
+
+//below this a rotation window is too long to follow spin up (700 RPM)
+#define MIN_RAD_PER_S			73.0f
+
+//per point offset from the window mean, averaged over rotations
+#define RIPPLE_FILTER			0.125f
+//rotations of points before ripple is judged
+#define RIPPLE_SETTLE_ROTATIONS	8
+//noise alone leaves the per point averages at RIPPLE_FILTER / 2 of the offset power - engage well
+//above that, let go closer to it
+#define RIPPLE_ENGAGE_RATIO		16.0f
+#define RIPPLE_RELEASE_RATIO	8.0f
+
+struct phase_point {
+	float accel_raw;
+	u_int32_t timestamp_cycles;
+};
+
+static bool initialized = false;
+
+//previous sample (or the point interpolated on the way to this one) and the angle since the last point
+static float last_accel_raw;
+static u_int32_t last_timestamp_cycles;
+static float last_angle;
+
+//last rotation worth of points
+static struct phase_point points[POINTS];
+static int next_point;
+static int point_count;
+
+//ripple locked to the rotation puts the same offset on a point every rotation, noise doesn't
+static float ripple[POINTS];
+static float offset_power;
+static u_int32_t ripple_points;
+static bool engaged = false;
+
+//averages (not samples) went to the estimator last
+static bool fed_average = false;
+
+static void reset_ripple(void)
+{
+	for (int x = 0; x < POINTS; x++) ripple[x] = 0.0f;
+	offset_power = 0.0f;
+	ripple_points = 0;
+	engaged = false;
+	fed_average = false;
+}
+
+void phase_sync_reset(void)
+{
+	initialized = false;
+	reset_ripple();
+}
+
+bool phase_sync_engaged(void)
+{
+	return engaged;
+}
+
+//point - index of the point just added to a full window, returns the window mean
+static float update_ripple(int point)
+{
+	float sum = 0.0f;
+	for (int x = 0; x < POINTS; x++) sum += points[x].accel_raw;
+
+	float mean = sum / POINTS;
+	float offset = points[point].accel_raw - mean;
+	float predicted_error = offset - ripple[point];
+
+	offset_power += RIPPLE_FILTER * (predicted_error * predicted_error - offset_power);
+	ripple[point] += RIPPLE_FILTER * predicted_error;
+	ripple_points++;
+
+	if (ripple_points < RIPPLE_SETTLE_ROTATIONS * POINTS) return mean;
+
+	//spread across the points - a speed change moves them all together
+	float ripple_sum = 0.0f;
+	float ripple_sum2 = 0.0f;
+	for (int x = 0; x < POINTS; x++) {
+		ripple_sum += ripple[x];
+		ripple_sum2 += ripple[x] * ripple[x];
+	}
+	float ripple_power = ripple_sum2 / POINTS - (ripple_sum / POINTS) * (ripple_sum / POINTS);
+	float noise_power = offset_power * RIPPLE_FILTER / 2.0f;
+
+	engaged = ripple_power > noise_power * (engaged ? RIPPLE_RELEASE_RATIO : RIPPLE_ENGAGE_RATIO);
+	return mean;
+}
+
+static void add_point(float accel_raw, u_int32_t timestamp_cycles)
+{
+	if (point_count < POINTS) point_count++;
+
+	points[next_point].accel_raw = accel_raw;
+	points[next_point].timestamp_cycles = timestamp_cycles;
+
+	next_point = (next_point + 1) % POINTS;
+}
+
+bool phase_sync_update(int32_t accel_raw, u_int32_t timestamp_cycles, float rad_per_s,
+		       int32_t *average_raw, u_int32_t *timestamp_cycles_out)
+{
+	u_int32_t elapsed_cycles = timestamp_cycles - last_timestamp_cycles;
+
+	if (!initialized || elapsed_cycles > sys_clock_hw_cycles_per_sec() / 1000 * MAX_SAMPLE_GAP_MS) {
+		last_accel_raw = accel_raw;
+		last_timestamp_cycles = timestamp_cycles;
+		last_angle = 0.0f;
+		next_point = 0;
+		point_count = 0;
+		initialized = true;
+		reset_ripple();
+		return false;
+	}
+
+	float angle = last_angle + rad_per_s * elapsed_cycles / sys_clock_hw_cycles_per_sec();
+	bool completed = false;
+	float mean = 0.0f;
+
+	//linear interpolation along this sample step for every point angle it passes
+	while (angle >= POINT_ANGLE) {
+		float fraction = (POINT_ANGLE - last_angle) / (angle - last_angle);
+
+		last_accel_raw += fraction * (accel_raw - last_accel_raw);
+		last_timestamp_cycles += (u_int32_t)(fraction * (timestamp_cycles - last_timestamp_cycles));
+		angle -= POINT_ANGLE;
+		last_angle = 0.0f;
+
+		add_point(last_accel_raw, last_timestamp_cycles);
+
+		if (point_count == POINTS) {
+			mean = update_ripple((next_point + POINTS - 1) % POINTS);
+			completed = true;
+		}
+	}
+
+	last_accel_raw = accel_raw;
+	last_timestamp_cycles = timestamp_cycles;
+	last_angle = angle;
+
+	if (!completed) return false;
+
+	//oldest point is the one about to be overwritten
+	u_int32_t oldest_cycles = points[next_point].timestamp_cycles;
+	u_int32_t newest_cycles = points[(next_point + POINTS - 1) % POINTS].timestamp_cycles;
+
+	*average_raw = (int32_t)lroundf(mean);
+	*timestamp_cycles_out = oldest_cycles + (newest_cycles - oldest_cycles) / 2;
+	return true;
+}
+
+enum phase_sync_feed phase_sync_select(int32_t accel_raw, u_int32_t timestamp_cycles, float rad_per_s,
+				       int32_t *estimator_raw, u_int32_t *estimator_cycles)
+{
+	int32_t average_raw;
+	u_int32_t average_cycles;
+	bool averaged = phase_sync_update(accel_raw, timestamp_cycles, rad_per_s, &average_raw, &average_cycles);
+
+	if (rad_per_s >= MIN_RAD_PER_S && engaged) {
+		if (!averaged) return PHASE_SYNC_FEED_NONE;
+
+		*estimator_raw = average_raw;
+		*estimator_cycles = average_cycles;
+
+		//window centre trails the single samples fed before - only a restart can go back to it
+		if (!fed_average) {
+			fed_average = true;
+			return PHASE_SYNC_FEED_RESTART;
+		}
+		return PHASE_SYNC_FEED_UPDATE;
+	}
+
+	fed_average = false;
+	*estimator_raw = accel_raw;
+	*estimator_cycles = timestamp_cycles;
+	return PHASE_SYNC_FEED_UPDATE;
+}
@@ -0,0 +1,38 @@
+#ifndef PHASE_SYNC_H_
+
+#define PHASE_SYNC_H_
+
+#include <zephyr/types.h>
+
+//Phase synchronous averaging of the accelerometer X axis
+//The sensor samples on its own clock, so samples can't be triggered at chosen angles - instead
+//every sample is placed at the rotation angle the tracked speed implies, X is interpolated at
+//CONFIG_MELTY_ACCEL_PHASE_SYNC_POINTS evenly spaced angles per rotation and the latest rotation
+//of those points is averaged. Ripple locked to the rotation (imbalance, sensor off centre, tilt)
+//sums to zero over the window instead of aliasing into the speed estimate
+
+void phase_sync_reset(void);
+
+//accel_raw - X axis normalized counts at timestamp_cycles, rad_per_s - current rotation speed
+//returns true each time a new point completes a full rotation window - *average_raw is the
+//window average and *timestamp_cycles the time at the window centre
+bool phase_sync_update(int32_t accel_raw, u_int32_t timestamp_cycles, float rad_per_s,
+		       int32_t *average_raw, u_int32_t *timestamp_cycles_out);
+
+enum phase_sync_feed {
+	PHASE_SYNC_FEED_NONE,		//waiting for the next average
+	PHASE_SYNC_FEED_UPDATE,
+	PHASE_SYNC_FEED_RESTART,	//just switched to averages - restart the estimator from this one
+};
+
+//what the rpm estimator is fed for this sample - rotation averages while the bot spins fast
+//enough for them (700 RPM) and the points show ripple locked to the rotation, the sample itself
+//otherwise (averages only cost latency when there is nothing to cancel)
+//the estimator has followed the ripple up to the switch, so its rate is restarted there
+enum phase_sync_feed phase_sync_select(int32_t accel_raw, u_int32_t timestamp_cycles, float rad_per_s,
+				       int32_t *estimator_raw, u_int32_t *estimator_cycles);
+
+//ripple locked to the rotation detected - phase_sync_select feeds averages above 700 RPM
+bool phase_sync_engaged(void);
+
+#endif
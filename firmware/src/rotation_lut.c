@@ -0,0 +1,77 @@
+#include <zephyr/types.h>
+#include <math.h>
+
+#include "rotation_lut.h"
+#include "accel.h"
+
+//table holds 2^30 / sqrt(raw counts)
+#define INV_SQRT_SHIFT			30
+
+//raw counts below this have their own table entry
+#define LUT_LINEAR_POINTS		32
+//above that - 16 evenly spaced points per doubling of raw counts (linear interpolation error < 0.04%)
+#define LUT_OCTAVE_BITS			4
+#define LUT_OCTAVE_STEPS		(1 << LUT_OCTAVE_BITS)
+//octaves above the linear part - enough to reach past ACCEL_RAW_MAX (16 << 13 = 131072)
+#define LUT_OCTAVES				13
+//last entry is the end point for interpolating the top of the range
+#define LUT_SIZE				(LUT_OCTAVE_STEPS + LUT_OCTAVES * LUT_OCTAVE_STEPS + 1)
+
+static u_int32_t inv_sqrt_lut[LUT_SIZE];
+
+//interval_us * sqrt(raw counts) for current radius
+static u_int32_t radius_scale = 0;
+static u_int16_t scale_radius_raw = 0;
+
+//raw counts at table index
+static u_int32_t lut_point(int index)
+{
+	if (index < LUT_LINEAR_POINTS) return index;
+
+	int exponent = (index - LUT_OCTAVE_STEPS) / LUT_OCTAVE_STEPS;
+	int mantissa = (index - LUT_OCTAVE_STEPS) % LUT_OCTAVE_STEPS;
+
+	return (u_int32_t)(LUT_OCTAVE_STEPS + mantissa) << exponent;
+}
+
+void init_rotation_lut(void)
+{
+	inv_sqrt_lut[0] = UINT32_MAX;	//never read - zero accel is clamped before lookup
+
+	for (int index = 1; index < LUT_SIZE; index++) {
+		inv_sqrt_lut[index] = (u_int32_t)((1UL << INV_SQRT_SHIFT) / sqrt(lut_point(index)) + 0.5);
+	}
+}
+
+void set_rotation_lut_radius(u_int16_t radius_raw)
+{
+	if (radius_raw == scale_radius_raw && radius_scale != 0) return;
+
+	//radius_raw is cm * 1000 - same factor as g = raw * mg per lsb / 1000, so they cancel
+	radius_scale = (u_int32_t)(60.0 * 1000 * 1000 * sqrt(radius_raw / (ACCEL_MG_PER_RAW * 89445.0)) + 0.5);
+	scale_radius_raw = radius_raw;
+}
+
+static u_int32_t get_inv_sqrt(u_int32_t accel_raw)
+{
+	if (accel_raw < LUT_LINEAR_POINTS) return inv_sqrt_lut[accel_raw];
+
+	//floating point style split - exponent picks the octave, top mantissa bits the table point
+	int exponent = (31 - __builtin_clz(accel_raw)) - LUT_OCTAVE_BITS;
+	int index = LUT_OCTAVE_STEPS + exponent * LUT_OCTAVE_STEPS + ((accel_raw >> exponent) - LUT_OCTAVE_STEPS);
+	u_int32_t fraction = accel_raw & ((1UL << exponent) - 1);
+
+	u_int32_t drop = inv_sqrt_lut[index] - inv_sqrt_lut[index + 1];
+	return inv_sqrt_lut[index] - (u_int32_t)(((u_int64_t)drop * fraction) >> exponent);
+}
+
+u_int32_t get_rotation_interval_us(int32_t accel_raw)
+{
+	if (accel_raw <= 0) return ROTATION_LUT_MAX_INTERVAL_US;
+	if (accel_raw > ACCEL_RAW_MAX) accel_raw = ACCEL_RAW_MAX;
+
+	u_int64_t interval_us = ((u_int64_t)get_inv_sqrt(accel_raw) * radius_scale) >> INV_SQRT_SHIFT;
+
+	if (interval_us > ROTATION_LUT_MAX_INTERVAL_US) return ROTATION_LUT_MAX_INTERVAL_US;
+	return interval_us;
+}
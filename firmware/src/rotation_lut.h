@@ -0,0 +1,23 @@
+#ifndef ROTATION_LUT_H_
+
+#define ROTATION_LUT_H_
+
+#include <zephyr/types.h>
+
+//Fixed point accel -> rotation interval
+//interval_us = 60e6 / sqrt(g * 89445 / radius_cm)  (from "G = 0.00001118 * r * RPM^2")
+//            = radius_scale / sqrt(raw counts)
+//1/sqrt(raw counts) comes from a log-linear table, radius_scale is only rebuilt when radius changes
+
+//longest interval reported (also returned for zero / negative accel)
+#define ROTATION_LUT_MAX_INTERVAL_US	250000
+
+void init_rotation_lut(void);
+
+//radius in centimeters * 1000 (as sent by BLE client)
+void set_rotation_lut_radius(u_int16_t radius_raw);
+
+//accel in normalized raw counts (see accel.h)
+u_int32_t get_rotation_interval_us(int32_t accel_raw);
+
+#endif
@@ -0,0 +1,47 @@
+#include <zephyr/types.h>
+
+#include "rotation_phase.h"
+
+//one full rotation of phase (2^32) * 1e6 (us per second)
+#define PHASE_PER_ROTATION_X1M	(1000000ULL << 32)
+
+u_int32_t us_to_phase(u_int32_t time_us, u_int32_t rotation_interval_us)
+{
+	if (time_us >= rotation_interval_us) return UINT32_MAX;
+	return ((u_int64_t)time_us << 32) / rotation_interval_us;
+}
+
+//phase step per cycle = 2^32 / cycles per rotation
+//scaled by 1e6 to stay in integers, split into quotient / remainder so the multiply in advance_rotation_phase can't overflow
+void set_phase_rate(struct rotation_phase_rate *rate, u_int32_t rotation_interval_us, u_int32_t cycles_per_sec)
+{
+	rate->rotation_cycles_x1m = (u_int64_t)rotation_interval_us * cycles_per_sec;
+	if (rate->rotation_cycles_x1m == 0) rate->rotation_cycles_x1m = 1;
+
+	rate->per_cycle = PHASE_PER_ROTATION_X1M / rate->rotation_cycles_x1m;
+	rate->per_cycle_remainder = PHASE_PER_ROTATION_X1M % rate->rotation_cycles_x1m;
+}
+
+void start_rotation_phase(struct rotation_phase *phase, u_int32_t now_cycles)
+{
+	phase->phase = 0;
+	phase->remainder = 0;
+	phase->last_cycles = now_cycles;
+}
+
+u_int32_t advance_rotation_phase(struct rotation_phase *phase, const struct rotation_phase_rate *rate, u_int32_t now_cycles)
+{
+	u_int32_t elapsed_cycles = now_cycles - phase->last_cycles;
+	phase->last_cycles = now_cycles;
+
+	//remainder is carried to the next step so no time is ever dropped
+	u_int64_t remainder = (u_int64_t)elapsed_cycles * rate->per_cycle_remainder + phase->remainder;
+	u_int64_t step = (u_int64_t)elapsed_cycles * rate->per_cycle + remainder / rate->rotation_cycles_x1m;
+	phase->remainder = remainder % rate->rotation_cycles_x1m;
+
+	u_int64_t next_phase = (u_int64_t)phase->phase + step;
+	phase->phase = (u_int32_t)next_phase;
+
+	//a long pass (or a slow rate change) can cover more than one rotation
+	return (u_int32_t)(next_phase >> 32);
+}
@@ -0,0 +1,37 @@
+#ifndef ROTATION_PHASE_H_
+
+#define ROTATION_PHASE_H_
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+
+//Free running rotation phase (NCO) - full u_int32_t range is one rotation
+//Advanced by elapsed cycles at the current angular velocity and never reset at a rotation
+//boundary, so the overshoot past one (and time spent outside the control loop) carries over
+
+struct rotation_phase {
+	u_int32_t phase;
+	u_int64_t remainder;			//phase * rotation_cycles_x1m not yet turned into a whole step
+	u_int32_t last_cycles;			//cycle count phase was last advanced to
+};
+
+//phase advance per cycle as quotient / remainder of (2^32 * 1e6) / rotation_cycles_x1m
+struct rotation_phase_rate {
+	u_int64_t per_cycle;
+	u_int64_t per_cycle_remainder;
+	u_int64_t rotation_cycles_x1m;	//cycles per rotation * 1e6
+};
+
+//edge time within rotation to phase - edges at / past end of rotation are never reached
+u_int32_t us_to_phase(u_int32_t time_us, u_int32_t rotation_interval_us);
+
+//cycles_per_sec - rate of the cycle counter passed to advance_rotation_phase
+void set_phase_rate(struct rotation_phase_rate *rate, u_int32_t rotation_interval_us, u_int32_t cycles_per_sec);
+
+//starts a spin at phase 0 from now_cycles - whatever went by since the last spin is not counted
+void start_rotation_phase(struct rotation_phase *phase, u_int32_t now_cycles);
+
+//advances phase by the time since the last call - returns the number of rotation boundaries crossed
+u_int32_t advance_rotation_phase(struct rotation_phase *phase, const struct rotation_phase_rate *rate, u_int32_t now_cycles);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef RPM_ESTIMATOR_H_
+
+#define RPM_ESTIMATOR_H_
+
+#include <zephyr/types.h>
+
+//Pluggable rotation speed estimator (implementation picked with MELTY_RPM_ESTIMATOR)
+//Fed every decoded accel sample by the sampling thread, then asked for the accel
+//expected at the time the rotation parameters built from it will be in use
+
+//longest extrapolation past the newest sample - phase synchronous averages are timestamped
+//at the middle of their rotation, so the newest one is up to half a rotation old
+#if defined(CONFIG_MELTY_ACCEL_PHASE_SYNC)
+#define RPM_ESTIMATOR_MAX_HORIZON_MS	50
+#else
+#define RPM_ESTIMATOR_MAX_HORIZON_MS	20
+#endif
+
+void rpm_estimator_reset(void);
+
+//X axis normalized raw counts (see accel.h) sampled at timestamp_cycles (k_cycle_get_32)
+void rpm_estimator_update(int32_t accel_raw, u_int32_t timestamp_cycles);
+
+//estimated X axis normalized raw counts at target_cycles - 0 until the first sample
+int32_t rpm_estimator_predict(u_int32_t target_cycles);
+
+#endif
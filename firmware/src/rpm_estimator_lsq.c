@@ -0,0 +1,67 @@
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+
+#include "rpm_estimator.h"
+#include "accel.h"
+
+//least squares line through the last few samples, evaluated at the target time
+
+//samples in the slope fit
+#define HISTORY_SIZE		8
+
+struct history_sample {
+	u_int32_t timestamp_cycles;
+	int32_t accel_raw;
+};
+
+static struct history_sample history[HISTORY_SIZE];
+static int history_count = 0;
+static int history_next = 0;
+
+void rpm_estimator_reset(void)
+{
+	history_count = 0;
+	history_next = 0;
+}
+
+void rpm_estimator_update(int32_t accel_raw, u_int32_t timestamp_cycles)
+{
+	history[history_next].timestamp_cycles = timestamp_cycles;
+	history[history_next].accel_raw = accel_raw;
+	history_next = (history_next + 1) % HISTORY_SIZE;
+	if (history_count < HISTORY_SIZE) history_count++;
+}
+
+int32_t rpm_estimator_predict(u_int32_t target_cycles)
+{
+	if (history_count == 0) return 0;
+
+	const struct history_sample *newest = &history[(history_next + HISTORY_SIZE - 1) % HISTORY_SIZE];
+	u_int32_t max_horizon = sys_clock_hw_cycles_per_sec() * RPM_ESTIMATOR_MAX_HORIZON_MS / 1000;
+	int64_t n = history_count;
+	int64_t sum_t = 0, sum_x = 0, sum_tt = 0, sum_tx = 0;
+
+	//times relative to newest sample keep the sums small
+	for (int x = 0; x < history_count; x++) {
+		int64_t t = (int32_t)(history[x].timestamp_cycles - newest->timestamp_cycles);
+		sum_t += t;
+		sum_x += history[x].accel_raw;
+		sum_tt += t * t;
+		sum_tx += t * history[x].accel_raw;
+	}
+
+	int64_t target_t = (int32_t)(target_cycles - newest->timestamp_cycles);
+	if (target_t < 0) target_t = 0;
+	if (target_t > max_horizon) target_t = max_horizon;
+
+	int64_t slope_den = n * sum_tt - sum_t * sum_t;
+	if (slope_den <= 0) return (int32_t)(sum_x / n);
+
+	//mean_x + slope * (target_t - mean_t), all over one common denominator
+	int64_t slope_num = n * sum_tx - sum_t * sum_x;
+	int64_t predicted = (sum_x * slope_den + slope_num * (n * target_t - sum_t)) / (n * slope_den);
+
+	if (predicted < 0) predicted = 0;
+	if (predicted > ACCEL_RAW_MAX) predicted = ACCEL_RAW_MAX;
+	return (int32_t)predicted;
+}
@@ -0,0 +1,55 @@
+#ifndef SENSOR_PUBLISH_H_
+
+#define SENSOR_PUBLISH_H_
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+//Lock free single writer / many reader publication of sensor values
+//Writer fills the buffer readers are not using, then flips to it by bumping the sequence
+//A reader retries whenever a publish lands while it is copying (the copy could only be torn by
+//two, as the writer fills the other buffer) - it never waits on a half finished write, so a high
+//priority reader can't stall behind a preempted sampling thread
+
+struct sensor_sample {
+	u_int32_t sequence;				//publish count - 0 means nothing published yet
+	u_int32_t timestamp_cycles;		//k_cycle_get_32() when sampled
+	float value;					//filtered value in engineering units
+	int32_t raw;					//filtered value in raw sensor counts
+};
+
+struct sensor_publication {
+	atomic_t sequence;
+	struct sensor_sample buffer[2];
+};
+
+//only one thread may publish to a given publication
+static inline void sensor_publish(struct sensor_publication *publication, float value, int32_t raw)
+{
+	u_int32_t sequence = (u_int32_t)atomic_get(&publication->sequence) + 1;
+	struct sensor_sample *sample = &publication->buffer[sequence & 1];
+
+	sample->sequence = sequence;
+	sample->timestamp_cycles = k_cycle_get_32();
+	sample->value = value;
+	sample->raw = raw;
+
+	//sample has to be complete before readers are pointed at it
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	atomic_set(&publication->sequence, sequence);
+}
+
+static inline void sensor_read(const struct sensor_publication *publication, struct sensor_sample *sample)
+{
+	u_int32_t sequence;
+
+	do {
+		sequence = (u_int32_t)atomic_get(&publication->sequence);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		*sample = publication->buffer[sequence & 1];
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	} while ((u_int32_t)atomic_get(&publication->sequence) != sequence);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#include <zephyr/types.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include "stats_v2.h"
+
+//ATT notification header - opcode and handle
+#define ATT_NOTIFY_OVERHEAD			3
+#define ATT_DEFAULT_MTU				23
+
+#define UINT24_MAX					0xffffff
+#define INT24_MAX					0x7fffff
+#define INT24_MIN					(-0x800000)
+
+//the central may never agree to a larger MTU - a record has to fit the default
+BUILD_ASSERT(STATS_V2_HEADER_SIZE + STATS_V2_RECORD_SIZE <= ATT_DEFAULT_MTU - ATT_NOTIFY_OVERHEAD,
+	     "stats v2 record doesn't fit a notification at the default ATT MTU");
+
+u_int32_t stats_v2_records_per_packet(u_int16_t att_mtu)
+{
+	if (att_mtu < ATT_NOTIFY_OVERHEAD + STATS_V2_HEADER_SIZE) return 0;
+	return (att_mtu - ATT_NOTIFY_OVERHEAD - STATS_V2_HEADER_SIZE) / STATS_V2_RECORD_SIZE;
+}
+
+void stats_v2_put_header(u_int8_t *packet, u_int32_t count)
+{
+	packet[0] = STATS_V2_VERSION;
+	packet[1] = count;
+}
+
+void stats_v2_put_record(const struct melty_telemetry_record *record, u_int8_t *dst)
+{
+	sys_put_le16(record->sequence, &dst[0]);
+	sys_put_le24(MIN(record->rotation_interval_us, UINT24_MAX), &dst[2]);
+	sys_put_le24((u_int32_t)CLAMP(record->accel_raw, INT24_MIN, INT24_MAX), &dst[5]);
+	sys_put_le16(record->battery_mv, &dst[8]);
+	sys_put_le16(record->loaded_mv, &dst[10]);
+	sys_put_le16(record->unloaded_mv, &dst[12]);
+	sys_put_le16(record->loop_jitter_us, &dst[14]);
+	sys_put_le16(record->spin_rate_rpm_s, &dst[16]);
+}
@@ -0,0 +1,22 @@
+#ifndef STATS_V2_H_
+
+#define STATS_V2_H_
+
+#include <zephyr/types.h>
+
+#include "melty_ble.h"
+
+//Stats v2 notification packing - layout under BT_UUID_MELTYBLE_STATS_V2 in melty_ble.h
+
+#define STATS_V2_HEADER_SIZE		2
+#define STATS_V2_RECORD_SIZE		18
+
+//records one notification carries at this ATT MTU - 1 at the default 23
+u_int32_t stats_v2_records_per_packet(u_int16_t att_mtu);
+
+void stats_v2_put_header(u_int8_t *packet, u_int32_t count);
+
+//dst - STATS_V2_RECORD_SIZE bytes, values out of the 24 bit fields' range saturate
+void stats_v2_put_record(const struct melty_telemetry_record *record, u_int8_t *dst);
+
+#endif
@@ -0,0 +1,176 @@
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <math.h>
+
+#include "tilt_comp.h"
+#include "accel.h"
+
+
+//gravity estimate time constant in rotations - longer rejects more noise, shorter follows tilt changes
+#define GRAVITY_FILTER_ROTATIONS	2.0f
+//centripetal reference time constant in rotations - well under the rotation rate so the reference
+//carries none of the ripple, second order so it still follows spin up without lagging
+#define REFERENCE_FILTER_ROTATIONS	1.0f
+//below this there's too little rotation per sample to separate gravity from centripetal
+#define MIN_RAD_PER_S			30.0f
+//allowance over the tilt Z implies (Z noise)
+#define TILT_MARGIN_RAW			(0.1f * ACCEL_ONE_G_RAW)
+//Z and tangential smoothing per sample
+#define Z_FILTER				0.02f
+#define TANGENTIAL_FILTER		0.05f
+//samples further apart than this restart the filter
+#define MAX_SAMPLE_GAP_MS		100
+
+struct complex_f {
+	float re;
+	float im;
+};
+
+static bool initialized = false;
+static u_int32_t last_timestamp_cycles;
+
+//e^(-i angle) - tracked rotation angle, advanced every sample
+static struct complex_f rotation = { 1.0f, 0.0f };
+//gravity vector for a spin in each direction, in the demodulated (non rotating) frame
+static struct complex_f gravity_against = { 0.0f, 0.0f };
+static struct complex_f gravity_with = { 0.0f, 0.0f };
+
+static float z_raw = 0.0f;
+static float tangential_raw = 0.0f;
+
+//X without gravity as the residual is taken against - the rpm estimator's prediction slowed down
+//(at low RPM the estimator follows the ripple, overshooting near its bandwidth - used directly, that
+//fed back through the correction and pushed the gravity estimate past the real tilt)
+static float reference_raw = 0.0f;
+static float reference_rate = 0.0f;		//counts per second
+
+static struct complex_f complex_mul(struct complex_f a, struct complex_f b)
+{
+	struct complex_f result = { a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re };
+	return result;
+}
+
+static struct complex_f complex_conj(struct complex_f a)
+{
+	struct complex_f result = { a.re, -a.im };
+	return result;
+}
+
+//step through angle with a short series instead of sinf / cosf (soft float) - renormalized so errors don't build up
+static void advance_rotation(float angle)
+{
+	float angle2 = angle * angle;
+	struct complex_f step = {
+		1.0f - angle2 / 2.0f + angle2 * angle2 / 24.0f,
+		-(angle - angle * angle2 / 6.0f + angle * angle2 * angle2 / 120.0f),
+	};
+
+	rotation = complex_mul(rotation, step);
+
+	float magnitude2 = rotation.re * rotation.re + rotation.im * rotation.im;
+	float correction = (3.0f - magnitude2) / 2.0f;	//one Newton step toward 1 / |rotation|
+	rotation.re *= correction;
+	rotation.im *= correction;
+}
+
+//critically damped, k - fraction of a time constant this sample covers
+static void update_reference(int32_t centripetal_raw, float k, float dt)
+{
+	if (k > 0.5f) k = 0.5f;
+
+	reference_raw += reference_rate * dt;
+
+	float error = centripetal_raw - reference_raw;
+	reference_raw += 2.0f * k * error;
+	reference_rate += k * k * error / dt;
+}
+
+static void restart_reference(int32_t centripetal_raw)
+{
+	reference_raw = centripetal_raw;
+	reference_rate = 0.0f;
+}
+
+static void limit_magnitude(struct complex_f *value, float limit)
+{
+	float magnitude2 = value->re * value->re + value->im * value->im;
+
+	if (magnitude2 <= limit * limit) return;
+
+	float scale = limit / sqrtf(magnitude2);
+	value->re *= scale;
+	value->im *= scale;
+}
+
+void tilt_comp_reset(void)
+{
+	initialized = false;
+}
+
+void tilt_comp_apply(struct accel_ring_sample *sample, int32_t centripetal_raw, u_int16_t radius_raw)
+{
+	u_int32_t elapsed_cycles = sample->timestamp_cycles - last_timestamp_cycles;
+	last_timestamp_cycles = sample->timestamp_cycles;
+
+	if (!initialized || elapsed_cycles > sys_clock_hw_cycles_per_sec() / 1000 * MAX_SAMPLE_GAP_MS) {
+		gravity_against = (struct complex_f){ 0.0f, 0.0f };
+		gravity_with = (struct complex_f){ 0.0f, 0.0f };
+		z_raw = sample->z;
+		tangential_raw = 0.0f;
+		restart_reference(centripetal_raw);
+		initialized = true;
+		return;
+	}
+
+	float dt = (float)elapsed_cycles / sys_clock_hw_cycles_per_sec();
+
+	float rad_per_s = accel_raw_to_rad_per_s(centripetal_raw, radius_raw);
+
+	if (sample->saturated || rad_per_s < MIN_RAD_PER_S) {
+		restart_reference(centripetal_raw);
+		advance_rotation(rad_per_s * dt);
+		return;
+	}
+
+	z_raw += Z_FILTER * (sample->z - z_raw);
+
+	//what's left after the non rotating (body frame) terms are taken out is gravity
+	float rotations = dt * rad_per_s / (2.0f * (float)M_PI);
+	update_reference(centripetal_raw, rotations / REFERENCE_FILTER_ROTATIONS, dt);
+
+	struct complex_f residual = { sample->x - reference_raw, sample->y - tangential_raw };
+	float k = rotations / GRAVITY_FILTER_ROTATIONS;
+	if (k > 1.0f) k = 1.0f;
+
+	struct complex_f demod_against = complex_mul(residual, complex_conj(rotation));
+	struct complex_f demod_with = complex_mul(residual, rotation);
+	gravity_against.re += k * (demod_against.re - gravity_against.re);
+	gravity_against.im += k * (demod_against.im - gravity_against.im);
+	gravity_with.re += k * (demod_with.re - gravity_with.re);
+	gravity_with.im += k * (demod_with.im - gravity_with.im);
+
+	//gravity in the spin plane can't be more than Z leaves over
+	float z_g2 = z_raw * z_raw;
+	float tilt_limit = sqrtf(ACCEL_ONE_G_RAW * ACCEL_ONE_G_RAW > z_g2 ? ACCEL_ONE_G_RAW * ACCEL_ONE_G_RAW - z_g2 : 0.0f) + TILT_MARGIN_RAW;
+	limit_magnitude(&gravity_against, tilt_limit);
+	limit_magnitude(&gravity_with, tilt_limit);
+
+	struct complex_f ripple_against = complex_mul(gravity_against, rotation);
+	struct complex_f ripple_with = complex_mul(gravity_with, complex_conj(rotation));
+	float corrected_x = sample->x - ripple_against.re - ripple_with.re;
+	float corrected_y = sample->y - ripple_against.im - ripple_with.im;
+
+	tangential_raw += TANGENTIAL_FILTER * (corrected_y - tangential_raw);
+
+	if (IS_ENABLED(CONFIG_MELTY_ACCEL_TILT_COMPENSATION)) {
+		sample->x = (int32_t)lroundf(corrected_x);
+		sample->y = (int32_t)lroundf(corrected_y);
+	}
+
+	advance_rotation(rad_per_s * dt);
+}
+
+float tilt_comp_get_tangential_raw(void)
+{
+	return tangential_raw;
+}
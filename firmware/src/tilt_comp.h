@@ -0,0 +1,26 @@
+#ifndef TILT_COMP_H_
+
+#define TILT_COMP_H_
+
+#include <zephyr/types.h>
+
+#include "accel_ring.h"
+
+//Gravity / tilt compensation for the spinning accelerometer
+//Sensor X is radial (centripetal), Y tangential, Z along the spin axis
+//Seen from the sensor, the part of gravity in the spin plane is a fixed size vector turning once
+//per rotation against the spin - a ripple on X / Y while the bot is tilted (wedge, uneven floor)
+//X + iY is demodulated at the tracked rotation angle (both spin directions), low passed over a
+//couple of rotations to find that vector and it is subtracted, bounded by the tilt Z allows
+
+void tilt_comp_reset(void);
+
+//corrects sample X / Y in place
+//centripetal_raw - current estimate of X without gravity (normalized counts)
+//radius_raw - accelerometer radius in cm * 1000 (as sent by BLE client)
+void tilt_comp_apply(struct accel_ring_sample *sample, int32_t centripetal_raw, u_int16_t radius_raw);
+
+//filtered tangential acceleration (Y without gravity) in normalized counts
+float tilt_comp_get_tangential_raw(void);
+
+#endif
@@ -13,19 +13,173 @@
 #include <math.h>
 
 #include "volt_monitor.h"
+#include "sensor_publish.h"
+#if defined(CONFIG_MELTY_BATTERY_ADC_SCAN)
+#include "adc_scan.h"
+#include "battery_load.h"
+#else
 #include "analog_in.h"
+#if defined(CONFIG_MELTY_ADC_BENCHMARK)
+#include <nrfx_timer.h>
+#include <nrfx_ppi.h>
+#include <hal/nrf_saadc.h>
+#endif
+#endif
 
 //AIN05 = pin 29
 #define BATTERY_V_ADC_CHANNEL 5	
 
 #define BATTERY_ADC_READS 1
 
+//results per benchmark report - 10 s at the 100 ms sample / scan buffer period
+#define ADC_BENCHMARK_REPORT_RESULTS 100
+
 #define BATTERY_VOLTAGE_DIVIDER_RATIO 11.1f	//For example - 11k to V+ and to 1k to GND
 
-static float battery_voltage = 0.0f;
+static struct sensor_publication battery_publication;
+
+
+#if defined(CONFIG_MELTY_ADC_BENCHMARK)
+static u_int32_t benchmark_results = 0;
+static float benchmark_mean = 0.0f;
+static float benchmark_m2 = 0.0f;
+static u_int32_t benchmark_wakeups = 0;
+static u_int32_t benchmark_start_ms = 0;
+
+//snapshot for the report - taken in whatever context produced the result
+static u_int32_t report_results;
+static float report_std_dev_mv;
+static u_int32_t report_wakeups;
+static u_int32_t report_ms;
+
+static void report_adc_benchmark(struct k_work *work)
+{
+	u_int32_t per_s_x10 = report_ms ? report_wakeups * 10000 / report_ms : 0;
+
+#if defined(CONFIG_MELTY_BATTERY_ADC_SCAN)
+	printk("Battery ADC (scan): ");
+#else
+	printk("Battery ADC (polled): ");
+#endif
+	printk("%u.%u wake-ups/s, noise %d.%02d mV std dev over %u results\n", per_s_x10 / 10, per_s_x10 % 10,
+		(int)report_std_dev_mv, (int)(report_std_dev_mv * 100.0f) % 100, report_results);
+}
+
+static K_WORK_DEFINE(adc_benchmark_work, report_adc_benchmark);
+
+//std dev of the unfiltered battery side voltage per result (Welford)
+static void record_adc_benchmark(float battery_side_voltage, u_int32_t wakeups)
+{
+	float delta = battery_side_voltage - benchmark_mean;
+
+	if (benchmark_results == 0) benchmark_start_ms = k_uptime_get_32();
+
+	benchmark_results++;
+	benchmark_wakeups += wakeups;
+	benchmark_mean += delta / benchmark_results;
+	benchmark_m2 += delta * (battery_side_voltage - benchmark_mean);
+
+	if (benchmark_results < ADC_BENCHMARK_REPORT_RESULTS) return;
+
+	report_results = benchmark_results;
+	report_std_dev_mv = sqrtf(benchmark_m2 / (benchmark_results - 1)) * 1000.0f;
+	report_wakeups = benchmark_wakeups;
+	report_ms = k_uptime_get_32() - benchmark_start_ms;
+	k_work_submit(&adc_benchmark_work);
+
+	benchmark_results = 0;
+	benchmark_mean = 0.0f;
+	benchmark_m2 = 0.0f;
+	benchmark_wakeups = 0;
+}
+#endif
+
+//only called from one context - the sampling thread or the SAADC interrupt
+static void filter_battery_voltage(float current_voltage) {
+	static float battery_voltage = 0.0f;
+
+	if (battery_voltage == 0) battery_voltage = current_voltage;
+	battery_voltage = (battery_voltage * 0.8f) + (current_voltage * BATTERY_VOLTAGE_DIVIDER_RATIO) * .2f;
+
+	//raw is in mV
+	sensor_publish(&battery_publication, battery_voltage, (int32_t)(battery_voltage * 1000.0f));
+}
+
+#if defined(CONFIG_MELTY_BATTERY_ADC_SCAN)
+
+static u_int32_t last_irq_count = 0;
+
+//SAADC interrupt - already averaged over a full scan buffer
+static void battery_scan_handler(float volts) {
+	filter_battery_voltage(volts);
+
+#if defined(CONFIG_MELTY_ADC_BENCHMARK)
+	u_int32_t irq_count = adc_scan_get_irq_count();
+
+	record_adc_benchmark(volts * BATTERY_VOLTAGE_DIVIDER_RATIO, irq_count - last_irq_count);
+	last_irq_count = irq_count;
+#endif
+}
+
+void init_volt_monitor(void) {
+#if defined(CONFIG_MELTY_BATTERY_LOAD_SYNC)
+	int ret = battery_load_init(BATTERY_V_ADC_CHANNEL, battery_scan_handler, BATTERY_VOLTAGE_DIVIDER_RATIO);
+#else
+	int ret = adc_scan_channel_add(BATTERY_V_ADC_CHANNEL, battery_scan_handler);
+#endif
+
+	if (ret >= 0) ret = adc_scan_start();
+	if (ret != 0) printk("Battery ADC scan failed to start (err %d)\n", ret);
+}
+
+#else
+
+#if defined(CONFIG_MELTY_ADC_BENCHMARK)
+//the Zephyr ADC driver takes an interrupt on SAADC END and CALIBRATEDONE - TIMER2 (free with the
+//scan off) counts those events through PPI, so wake-ups per read are counted rather than assumed
+#define IRQ_COUNT_TIMER_INSTANCE	2
+
+static const nrfx_timer_t irq_count_timer = NRFX_TIMER_INSTANCE(IRQ_COUNT_TIMER_INSTANCE);
+static u_int32_t last_saadc_irqs = 0;
+
+//counter mode - never compares, so never interrupts
+static void irq_count_timer_handler(nrf_timer_event_t event, void *context)
+{
+}
+
+static int count_saadc_event(nrf_saadc_event_t event)
+{
+	nrf_ppi_channel_t ppi_channel;
 
-struct k_mutex volt_monitor_mutex;
+	if (nrfx_ppi_channel_alloc(&ppi_channel) != NRFX_SUCCESS) return -EBUSY;
+	nrfx_ppi_channel_assign(ppi_channel, nrf_saadc_event_address_get(NRF_SAADC, event),
+				nrfx_timer_task_address_get(&irq_count_timer, NRF_TIMER_TASK_COUNT));
+	nrfx_ppi_channel_enable(ppi_channel);
+
+	return 0;
+}
 
+static int init_saadc_irq_count(void)
+{
+	nrfx_timer_config_t timer_config = NRFX_TIMER_DEFAULT_CONFIG;
+
+	timer_config.mode = NRF_TIMER_MODE_COUNTER;
+	timer_config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+	if (nrfx_timer_init(&irq_count_timer, &timer_config, irq_count_timer_handler) != NRFX_SUCCESS) return -EIO;
+
+	int ret = count_saadc_event(NRF_SAADC_EVENT_END);
+	if (ret == 0) ret = count_saadc_event(NRF_SAADC_EVENT_CALIBRATEDONE);
+	if (ret != 0) return ret;
+
+	nrfx_timer_enable(&irq_count_timer);
+	return 0;
+}
+
+static u_int32_t get_saadc_irq_count(void)
+{
+	return nrfx_timer_capture(&irq_count_timer, NRF_TIMER_CC_CHANNEL0);
+}
+#endif
 
 float adc_multi_sample(int samples, int adc_channel) {
 	float multi_sample = 0;
@@ -35,20 +189,37 @@ float adc_multi_sample(int samples, int adc_channel) {
     return multi_sample / samples;
 }
 
+void init_volt_monitor(void) {
+#if defined(CONFIG_MELTY_ADC_BENCHMARK)
+	int ret = init_saadc_irq_count();
+
+	if (ret != 0) printk("Battery ADC benchmark: no SAADC interrupt count (err %d)\n", ret);
+#endif
+}
 
 void update_battery_voltage(void) {
 	float current_voltage = adc_multi_sample(BATTERY_ADC_READS, BATTERY_V_ADC_CHANNEL);
-	
-	k_mutex_lock(&volt_monitor_mutex, K_FOREVER);
-	if (battery_voltage == 0) battery_voltage = current_voltage;
-	battery_voltage = (battery_voltage * 0.8f) + (current_voltage * BATTERY_VOLTAGE_DIVIDER_RATIO) * .2f;
-	k_mutex_unlock(&volt_monitor_mutex);
+
+	filter_battery_voltage(current_voltage);
+
+#if defined(CONFIG_MELTY_ADC_BENCHMARK)
+	u_int32_t saadc_irqs = get_saadc_irq_count();
+
+	//this pass woke from the sampling thread's sleep, plus whatever SAADC interrupts its reads took
+	record_adc_benchmark(current_voltage * BATTERY_VOLTAGE_DIVIDER_RATIO, 1 + saadc_irqs - last_saadc_irqs);
+	last_saadc_irqs = saadc_irqs;
+#endif
+}
+
+#endif
+
+void get_battery_sample(struct sensor_sample *sample) {
+	sensor_read(&battery_publication, sample);
 }
 
 float get_battery_voltage(void) {
-	k_mutex_lock(&volt_monitor_mutex, K_FOREVER);
-	float voltage = battery_voltage;
-	k_mutex_unlock(&volt_monitor_mutex);
+	struct sensor_sample sample;
+	sensor_read(&battery_publication, &sample);
 
-	return voltage;
+	return sample.value;
 }
@@ -2,8 +2,17 @@
 
 #define VOLT_MONITOR_H_
 
+#include "sensor_publish.h"
+
 float get_battery_voltage(void);
 
+//latest filtered sample with its timestamp and sequence number (raw in mV)
+void get_battery_sample(struct sensor_sample *sample);
+
+//starts the SAADC scan (CONFIG_MELTY_BATTERY_ADC_SCAN) - nothing to do for polled sampling
+void init_volt_monitor(void);
+
+//polled sampling only - called from the battery sampling thread
 void update_battery_voltage(void);
 
 #endif
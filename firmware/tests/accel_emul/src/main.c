@@ -0,0 +1,202 @@
+/*
+ * Accelerometer path end to end on native_posix - accel.c through the sensor API backend and the
+ * H3LIS331DL driver against its i2c emulator, estimated RPM checked against the spin profile
+ */
+
+#include <ztest.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <math.h>
+
+#include "accel.h"
+#include "accel_cal.h"
+#include "melty_ble.h"
+#include "h3lis331dl_emul.h"
+
+//as sent by the BLE client - cm * 1000
+#define RADIUS_RAW				3000
+#define RADIUS_M				(RADIUS_RAW / 100000.0f)
+
+//same as the app's sampling thread (src/main.c)
+#define STACK_SIZE				2048
+#define SAMPLING_PRIORITY		7
+
+#define ACCEL_ODR_HZ			400
+
+#define CHECK_INTERVAL_MS		50
+//no checks this long after each segment starts - estimator / tilt / phase sync catching up
+#define SETTLE_MS				500
+//X at standstill is gravity from the tilt alone - RPM checks start above that
+#define MIN_CHECKED_RPM			300.0f
+
+#define MAX_ERROR_FRACTION		0.03f
+#define MAX_ERROR_RPM			20.0f
+
+//spin up through phase sync engaging, hold, spin down across the range switch to 100 g, hold
+static const struct h3lis331dl_emul_segment spin_segments[] = {
+	{ .duration_ms = 500, .rpm_start = 0, .rpm_end = 0 },
+	{ .duration_ms = 2000, .rpm_start = 0, .rpm_end = 2000 },
+	{ .duration_ms = 2000, .rpm_start = 2000, .rpm_end = 2000 },
+	{ .duration_ms = 1500, .rpm_start = 2000, .rpm_end = 600 },
+	{ .duration_ms = 2000, .rpm_start = 600, .rpm_end = 600 },
+};
+
+static const struct h3lis331dl_emul_profile spin_profile = {
+	.segments = spin_segments,
+	.segment_count = ARRAY_SIZE(spin_segments),
+	.radius_m = RADIUS_M,
+	.tilt_deg = 5.0f,
+	.repeat = false,
+};
+
+static const struct h3lis331dl_emul_segment hold_segments[] = {
+	{ .duration_ms = 2000, .rpm_start = 1500, .rpm_end = 1500 },
+};
+
+static const struct h3lis331dl_emul_profile hold_profile = {
+	.segments = hold_segments,
+	.segment_count = ARRAY_SIZE(hold_segments),
+	.radius_m = RADIUS_M,
+	.tilt_deg = 0.0f,
+	.repeat = false,
+};
+
+static K_THREAD_STACK_DEFINE(sampling_stack, STACK_SIZE);
+static struct k_thread sampling_thread;
+
+static const struct emul *accel_emul;
+
+//melty_ble.c is not linked - fixed radius
+u_int16_t get_radius_raw(void)
+{
+	return RADIUS_RAW;
+}
+
+//accel_cal.c (and settings) are not linked - no offsets, nothing captured
+void accel_cal_apply(struct accel_ring_sample *sample)
+{
+}
+
+void accel_cal_update(const struct accel_ring_sample *sample)
+{
+}
+
+static void sampling(void *p1, void *p2, void *p3)
+{
+	while (1) wait_accel_sample();
+}
+
+//profile RPM at t ms, and whether t is far enough into its segment to check against
+static float profile_rpm(const struct h3lis331dl_emul_profile *profile, u_int32_t t_ms, bool *settled)
+{
+	for (int x = 0; x < profile->segment_count; x++) {
+		const struct h3lis331dl_emul_segment *segment = &profile->segments[x];
+
+		if (t_ms < segment->duration_ms || x == profile->segment_count - 1) {
+			float fraction = t_ms < segment->duration_ms ? (float)t_ms / segment->duration_ms : 1.0f;
+
+			*settled = t_ms >= SETTLE_MS;
+			return segment->rpm_start + (segment->rpm_end - segment->rpm_start) * fraction;
+		}
+
+		t_ms -= segment->duration_ms;
+	}
+
+	*settled = false;
+	return 0.0f;
+}
+
+static u_int32_t profile_ms(const struct h3lis331dl_emul_profile *profile)
+{
+	u_int32_t total = 0;
+
+	for (int x = 0; x < profile->segment_count; x++) total += profile->segments[x].duration_ms;
+	return total;
+}
+
+static float estimated_rpm(void)
+{
+	return accel_raw_to_rad_per_s(get_accel_raw(), RADIUS_RAW) * 60.0f / (2.0f * (float)M_PI);
+}
+
+static void *accel_emul_setup(void)
+{
+	accel_emul = emul_get_binding(DT_LABEL(DT_NODELABEL(accel)));
+	zassert_not_null(accel_emul, "no H3LIS331DL emulator");
+
+	init_accel();
+	k_thread_create(&sampling_thread, sampling_stack, K_THREAD_STACK_SIZEOF(sampling_stack), sampling,
+			NULL, NULL, NULL, SAMPLING_PRIORITY, 0, K_NO_WAIT);
+
+	return NULL;
+}
+
+ZTEST(accel_emul, test_rpm_follows_profile)
+{
+	struct accel_stats before;
+	struct accel_stats after;
+	float worst = 0.0f;
+	float worst_expected = 0.0f;
+	u_int32_t checks = 0;
+
+	get_accel_stats(&before);
+	zassert_ok(h3lis331dl_emul_set_profile(accel_emul, &spin_profile), NULL);
+	int64_t start = k_uptime_get();
+
+	for (u_int32_t t = CHECK_INTERVAL_MS; t <= profile_ms(&spin_profile); t += CHECK_INTERVAL_MS) {
+		bool settled;
+
+		k_sleep(K_TIMEOUT_ABS_MS(start + t));
+
+		float expected = profile_rpm(&spin_profile, t, &settled);
+		float rpm = estimated_rpm();
+
+		if (!settled || expected < MIN_CHECKED_RPM) continue;
+
+		zassert_within(rpm, expected, expected * MAX_ERROR_FRACTION + MAX_ERROR_RPM,
+			       "%u ms: %.0f RPM, profile %.0f RPM", t, rpm, expected);
+		checks++;
+
+		if (fabsf(rpm - expected) > worst) {
+			worst = fabsf(rpm - expected);
+			worst_expected = expected;
+		}
+	}
+
+	get_accel_stats(&after);
+	TC_PRINT("%u checks, worst error %.1f RPM at %.0f RPM, %u range switches\n", checks, worst,
+		 worst_expected, after.range_switches - before.range_switches);
+
+	zassert_true(checks > 0, NULL);
+	//2000 RPM at 3 cm is ~134 g, 600 RPM ~12 g - the spin down has to end on the 100 g range
+	zassert_equal(after.range_g, 100, "still on the %u g range", after.range_g);
+	zassert_true(after.range_switches > before.range_switches, NULL);
+}
+
+ZTEST(accel_emul, test_every_sample_read)
+{
+	struct accel_stats before;
+	struct accel_stats after;
+
+	zassert_ok(h3lis331dl_emul_set_profile(accel_emul, &hold_profile), NULL);
+	//range switch (if any) and estimator settle before counting
+	k_sleep(K_MSEC(SETTLE_MS));
+
+	get_accel_stats(&before);
+	k_sleep(K_MSEC(profile_ms(&hold_profile) - SETTLE_MS));
+	get_accel_stats(&after);
+
+	u_int32_t samples = after.samples - before.samples;
+	u_int32_t expected = (profile_ms(&hold_profile) - SETTLE_MS) * ACCEL_ODR_HZ / 1000;
+
+	TC_PRINT("%u samples (%u expected), %.0f RPM\n", samples, expected, estimated_rpm());
+
+	zassert_within(samples, expected, 2, NULL);
+	zassert_equal(after.dropped_samples, before.dropped_samples, "sensor overran - samples not read in time");
+	zassert_equal(after.missed_interrupts, before.missed_interrupts, "data ready trigger missed");
+	zassert_within(estimated_rpm(), 1500.0f, 1500.0f * MAX_ERROR_FRACTION + MAX_ERROR_RPM, NULL);
+}
+
+ZTEST_SUITE(accel_emul, NULL, accel_emul_setup, NULL, NULL, NULL);
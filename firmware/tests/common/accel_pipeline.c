@@ -0,0 +1,86 @@
+#include <ztest.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <math.h>
+
+#include "accel_pipeline.h"
+#include "rpm_estimator.h"
+
+float accel_pipeline_predict(const struct accel_trace_config *config, const struct accel_trace_sample *sample)
+{
+	u_int32_t half_period_cycles = sys_clock_hw_cycles_per_sec() / config->odr_hz / 2;
+	int32_t predicted_raw = rpm_estimator_predict(sample->sample.timestamp_cycles + half_period_cycles);
+
+	return accel_trace_raw_to_speed(predicted_raw, config->radius_cm);
+}
+
+static struct accel_pipeline_result run_pipeline(const struct accel_trace_config *config, double settle_s,
+						 const struct accel_pipeline *pipeline)
+{
+	struct accel_trace trace;
+	struct accel_trace_sample sample;
+	struct heading_drift drift;
+	double tangential_error2 = 0.0;
+	u_int32_t scored = 0;
+	bool hit = false;
+	double hit_error_rad = 0.0;
+	double recovered_s = 0.0;
+
+	pipeline->reset();
+	heading_drift_start(&drift);
+	accel_trace_start(&trace, config);
+
+	while (accel_trace_next(&trace, &sample)) {
+		float tangential_raw = 0.0f;
+		float rad_per_s = pipeline->update(config, &sample, &tangential_raw);
+
+		if (sample.time_s < settle_s) continue;
+
+		if (config->impact_s > 0.0f && sample.time_s >= config->impact_s) {
+			if (!hit) hit_error_rad = drift.error_rad;
+			hit = true;
+
+			if (fabsf(rad_per_s - sample.rad_per_s) > RECOVERED_FRACTION * sample.rad_per_s) {
+				recovered_s = sample.time_s + 1.0 / config->odr_hz;
+			}
+		}
+
+		heading_drift_update(&drift, config, &sample, rad_per_s);
+		tangential_error2 += (tangential_raw - sample.tangential_raw) * (tangential_raw - sample.tangential_raw);
+		scored++;
+	}
+
+	struct accel_pipeline_result result = {
+		.drift_deg = heading_drift_deg_per_rotation(&drift),
+		.window_drift_deg = heading_drift_window_rms_deg(&drift),
+		.rpm_rms = heading_drift_rpm_rms(&drift),
+		.tangential_rms = pipeline->scores_tangential && scored ? sqrt(tangential_error2 / scored) : 0.0f,
+		.recovery_ms = hit && recovered_s > config->impact_s ? (recovered_s - config->impact_s) * 1000.0 : 0.0f,
+		.impact_heading_deg = hit ? fabs(drift.error_rad - hit_error_rad) * 180.0 / M_PI : 0.0f,
+	};
+	return result;
+}
+
+struct accel_pipeline_results accel_pipeline_compare(const char *name, const struct accel_trace_config *config,
+						     double settle_s, const struct accel_pipeline *before,
+						     const struct accel_pipeline *after)
+{
+	struct accel_pipeline_results results = {
+		.before = run_pipeline(config, settle_s, before),
+		.after = run_pipeline(config, settle_s, after),
+	};
+
+	TC_PRINT("%s: drift %.3f -> %.3f deg/rotation, %.2f -> %.2f deg rms per %.1f s, rpm rms %.2f -> %.2f", name,
+		 results.before.drift_deg, results.after.drift_deg, results.before.window_drift_deg,
+		 results.after.window_drift_deg, HEADING_WINDOW_S, results.before.rpm_rms, results.after.rpm_rms);
+	if (before->scores_tangential && after->scores_tangential) {
+		TC_PRINT(", tangential rms %.1f -> %.1f counts", results.before.tangential_rms, results.after.tangential_rms);
+	}
+	if (config->impact_s > 0.0f) {
+		TC_PRINT(", recovery %.1f -> %.1f ms, heading %.1f -> %.1f deg after the hit", results.before.recovery_ms,
+			 results.after.recovery_ms, results.before.impact_heading_deg, results.after.impact_heading_deg);
+	}
+	TC_PRINT(" (%s -> %s)\n", before->name, after->name);
+
+	return results;
+}
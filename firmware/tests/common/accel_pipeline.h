@@ -0,0 +1,52 @@
+#ifndef ACCEL_PIPELINE_H_
+
+#define ACCEL_PIPELINE_H_
+
+#include <zephyr/types.h>
+
+#include "accel_trace.h"
+
+//Trace runner shared by the accel pipeline suites - one trace replayed through two ways of turning
+//samples into the speed the control loop runs at (the pipeline code under test keeps single
+//instances of its state, so the pipelines run one after the other), each scored on heading drift,
+//RPM error and optionally its tangential estimate
+
+struct accel_pipeline {
+	const char *name;
+	//back to power up state before the trace
+	void (*reset)(void);
+	//one trace sample in, speed (rad/s) for the coming sample period out
+	//*tangential_raw - its Y (spin up / down) estimate, only read if scores_tangential
+	float (*update)(const struct accel_trace_config *config, const struct accel_trace_sample *sample,
+			float *tangential_raw);
+	bool scores_tangential;
+};
+
+#define RECOVERED_FRACTION		0.005f
+
+struct accel_pipeline_result {
+	float drift_deg;			//mean heading error gained per rotation
+	float window_drift_deg;		//rms heading error gained per HEADING_WINDOW_S
+	float rpm_rms;
+	float tangential_rms;		//0 unless the pipeline scores_tangential
+	//traces with an impact - from the hit until speed stays within RECOVERED_FRACTION, and heading
+	//error gained from the hit to the trace end
+	float recovery_ms;
+	float impact_heading_deg;
+};
+
+struct accel_pipeline_results {
+	struct accel_pipeline_result before;
+	struct accel_pipeline_result after;
+};
+
+//before runs first, after last - pipeline state read after this is the after pipeline's at the trace end
+//samples before settle_s are fed but not scored
+struct accel_pipeline_results accel_pipeline_compare(const char *name, const struct accel_trace_config *config,
+						     double settle_s, const struct accel_pipeline *before,
+						     const struct accel_pipeline *after);
+
+//rpm_estimator's prediction for the middle of the coming sample period, as update_accel_prediction() asks
+float accel_pipeline_predict(const struct accel_trace_config *config, const struct accel_trace_sample *sample);
+
+#endif
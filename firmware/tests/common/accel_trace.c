@@ -0,0 +1,180 @@
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <math.h>
+
+#include "accel_trace.h"
+#include "accel.h"
+
+//m/s^2 per normalized count (as accel.c)
+#define MS2_PER_RAW				(ACCEL_MG_PER_RAW * 9.80665 / 1000.0)
+#define RPM_TO_RAD_PER_S		(2.0 * M_PI / 60.0)
+
+//timestamps start just short of the cycle counter wrapping, so every trace crosses it
+#define START_CYCLES_BEFORE_WRAP_S	0.25
+
+static double ramp_rate(const struct accel_trace_config *config)
+{
+	if (config->ramp_s <= 0.0f) return 0.0;
+	return (config->end_rpm - config->start_rpm) * RPM_TO_RAD_PER_S / config->ramp_s;
+}
+
+float accel_trace_rad_per_s(const struct accel_trace_config *config, double time_s)
+{
+	if (time_s >= config->ramp_s) return config->end_rpm * RPM_TO_RAD_PER_S;
+	return config->start_rpm * RPM_TO_RAD_PER_S + ramp_rate(config) * time_s;
+}
+
+//exact integral of the speed profile
+static double trace_angle(const struct accel_trace_config *config, double time_s)
+{
+	double start = config->start_rpm * RPM_TO_RAD_PER_S;
+	double ramp_s = config->ramp_s > 0.0f ? config->ramp_s : 0.0;
+
+	if (time_s < ramp_s) return start * time_s + ramp_rate(config) * time_s * time_s / 2.0;
+	return start * ramp_s + ramp_rate(config) * ramp_s * ramp_s / 2.0 +
+	       config->end_rpm * RPM_TO_RAD_PER_S * (time_s - ramp_s);
+}
+
+float accel_trace_speed_to_raw(float rad_per_s, float radius_cm)
+{
+	return rad_per_s * rad_per_s * (radius_cm / 100.0) / MS2_PER_RAW;
+}
+
+float accel_trace_raw_to_speed(float accel_raw, float radius_cm)
+{
+	if (accel_raw <= 0.0f) return 0.0f;
+	return sqrt(accel_raw * MS2_PER_RAW / (radius_cm / 100.0));
+}
+
+//uniform (0, 1]
+static double next_uniform(u_int32_t *seed)
+{
+	*seed = *seed * 1664525 + 1013904223;
+	return ((*seed >> 8) + 1) / 16777216.0;
+}
+
+//Box-Muller
+static double next_gaussian(u_int32_t *seed)
+{
+	double u1 = next_uniform(seed);
+	double u2 = next_uniform(seed);
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static int32_t sensor_value(struct accel_trace *trace, double value)
+{
+	int32_t quantization = trace->config.quantization_raw > 1 ? trace->config.quantization_raw : 1;
+
+	value += trace->config.noise_raw * next_gaussian(&trace->seed);
+	return (int32_t)lround(value / quantization) * quantization;
+}
+
+void accel_trace_start(struct accel_trace *trace, const struct accel_trace_config *config)
+{
+	trace->config = *config;
+	trace->index = 0;
+	trace->seed = config->seed;
+	trace->angle_rad = 0.0;
+	trace->time_s = 0.0;
+}
+
+bool accel_trace_next(struct accel_trace *trace, struct accel_trace_sample *sample)
+{
+	const struct accel_trace_config *config = &trace->config;
+	u_int64_t cycles_per_sec = sys_clock_hw_cycles_per_sec();
+	double time_s = (double)trace->index / config->odr_hz;
+
+	if (time_s >= config->duration_s) return false;
+
+	double angle = trace_angle(config, time_s);
+	double rad_per_s = accel_trace_rad_per_s(config, time_s);
+	double centripetal = accel_trace_speed_to_raw(rad_per_s, config->radius_cm);
+	double tangential = (time_s < config->ramp_s ? ramp_rate(config) : 0.0) * (config->radius_cm / 100.0) / MS2_PER_RAW;
+
+	//gravity is still while the sensor turns - in the sensor frame it turns against the spin
+	double tilt = config->tilt_deg * M_PI / 180.0;
+	double gravity_plane = ACCEL_ONE_G_RAW * sin(tilt);
+
+	double x = centripetal * (1.0 + config->ripple_1x * cos(angle) + config->ripple_2x * cos(2.0 * angle)) +
+		   gravity_plane * cos(angle);
+	double y = tangential - gravity_plane * sin(angle);
+
+	if (config->impact_s > 0.0f && time_s >= config->impact_s) {
+		int hit_sample = (int)lround((time_s - config->impact_s) * config->odr_hz);
+
+		if (hit_sample < IMPACT_SAMPLES) x += config->impact_g * ACCEL_ONE_G_RAW * pow(-IMPACT_RING, hit_sample);
+	}
+	double z = ACCEL_ONE_G_RAW * cos(tilt);
+
+	u_int64_t start_cycles = (u_int64_t)UINT32_MAX + 1 - (u_int64_t)(START_CYCLES_BEFORE_WRAP_S * cycles_per_sec);
+
+	sample->sample.timestamp_cycles = (u_int32_t)(start_cycles + trace->index * cycles_per_sec / config->odr_hz);
+	sample->sample.x = sensor_value(trace, x);
+	sample->sample.y = sensor_value(trace, y);
+	sample->sample.z = sensor_value(trace, z);
+	sample->sample.saturated = false;
+	sample->time_s = time_s;
+	sample->angle_rad = angle;
+	sample->rad_per_s = rad_per_s;
+	sample->tangential_raw = tangential;
+
+	trace->index++;
+	return true;
+}
+
+void heading_drift_start(struct heading_drift *drift)
+{
+	*drift = (struct heading_drift){ .next_rotation_rad = -1.0, .window_end_s = -1.0 };
+}
+
+void heading_drift_update(struct heading_drift *drift, const struct accel_trace_config *config,
+			  const struct accel_trace_sample *sample, float estimated_rad_per_s)
+{
+	double period_s = 1.0 / config->odr_hz;
+	double true_end_rad = trace_angle(config, sample->time_s + period_s);
+
+	//rotations and windows counted from the first sample
+	if (drift->next_rotation_rad < 0.0) drift->next_rotation_rad = sample->angle_rad + 2.0 * M_PI;
+	if (drift->window_end_s < 0.0) drift->window_end_s = sample->time_s + HEADING_WINDOW_S;
+
+	drift->error_rad += estimated_rad_per_s * period_s - (true_end_rad - sample->angle_rad);
+
+	if (true_end_rad >= drift->next_rotation_rad) {
+		drift->abs_drift_sum_rad += fabs(drift->error_rad - drift->rotation_start_error_rad);
+		drift->rotation_start_error_rad = drift->error_rad;
+		drift->next_rotation_rad += 2.0 * M_PI;
+		drift->rotations++;
+	}
+
+	if (sample->time_s + period_s >= drift->window_end_s) {
+		double gained = drift->error_rad - drift->window_start_error_rad;
+
+		drift->window_drift_sum2 += gained * gained;
+		drift->window_start_error_rad = drift->error_rad;
+		drift->window_end_s += HEADING_WINDOW_S;
+		drift->windows++;
+	}
+
+	double rpm_error = (estimated_rad_per_s - accel_trace_rad_per_s(config, sample->time_s + period_s / 2.0)) /
+			   RPM_TO_RAD_PER_S;
+	drift->rpm_error_sum2 += rpm_error * rpm_error;
+	drift->rpm_samples++;
+}
+
+float heading_drift_deg_per_rotation(const struct heading_drift *drift)
+{
+	if (drift->rotations == 0) return 0.0f;
+	return drift->abs_drift_sum_rad / drift->rotations * 180.0 / M_PI;
+}
+
+float heading_drift_rpm_rms(const struct heading_drift *drift)
+{
+	if (drift->rpm_samples == 0) return 0.0f;
+	return sqrt(drift->rpm_error_sum2 / drift->rpm_samples);
+}
+
+float heading_drift_window_rms_deg(const struct heading_drift *drift)
+{
+	if (drift->windows == 0) return 0.0f;
+	return sqrt(drift->window_drift_sum2 / drift->windows) * 180.0 / M_PI;
+}
@@ -0,0 +1,102 @@
+#ifndef ACCEL_TRACE_H_
+
+#define ACCEL_TRACE_H_
+
+#include <zephyr/types.h>
+
+#include "accel_ring.h"
+
+//Synthetic accelerometer traces for the accel pipeline tests - a bot spinning through a speed
+//profile with the sensor at a fixed radius, sampled at the sensor's ODR
+//Sensor X is radial (centripetal), Y tangential, Z along the spin axis, all in normalized
+//raw counts (see accel.h). Every trace is generated from its seed, so runs repeat exactly
+
+//samples a hit rings for - each opposite the last at IMPACT_RING of its size
+#define IMPACT_SAMPLES			4
+#define IMPACT_RING				0.6
+
+struct accel_trace_config {
+	u_int32_t odr_hz;
+	float radius_cm;
+	//speed ramps linearly from start to end over ramp_s, then holds until duration_s
+	float start_rpm;
+	float end_rpm;
+	float ramp_s;
+	float duration_s;
+	float noise_raw;			//gaussian noise on every axis, rms
+	int32_t quantization_raw;	//counts per sensor LSB (0 or 1 = none)
+	float tilt_deg;				//spin axis away from vertical - gravity ripple on X / Y
+	float ripple_1x;			//once per rotation ripple on X, fraction of centripetal (imbalance)
+	float ripple_2x;			//twice per rotation ripple on X, fraction of centripetal
+	float impact_s;				//hit at this time (0 = none) - a ringing spike on X
+	float impact_g;				//first sample of the hit, the next IMPACT_SAMPLES - 1 ring down
+	u_int32_t seed;
+};
+
+//400 Hz, 3 cm radius (as the tests' BLE radius) - the rest by designated initializer
+#define ACCEL_TRACE(start, end, ramp, duration, ...) \
+	{ .odr_hz = 400, .radius_cm = 3.0f, .start_rpm = (start), .end_rpm = (end), .ramp_s = (ramp), \
+	  .duration_s = (duration), __VA_ARGS__ }
+
+struct accel_trace_sample {
+	struct accel_ring_sample sample;
+	double time_s;
+	double angle_rad;			//true rotation angle at the sample
+	float rad_per_s;			//true speed at the sample
+	float tangential_raw;		//true Y without gravity
+};
+
+struct accel_trace {
+	struct accel_trace_config config;
+	u_int32_t index;
+	u_int32_t seed;
+	double angle_rad;
+	double time_s;
+};
+
+void accel_trace_start(struct accel_trace *trace, const struct accel_trace_config *config);
+
+//false once duration_s has been generated
+bool accel_trace_next(struct accel_trace *trace, struct accel_trace_sample *sample);
+
+//true speed (rad/s) at time_s
+float accel_trace_rad_per_s(const struct accel_trace_config *config, double time_s);
+
+//centripetal accel in normalized counts for a speed, and back
+float accel_trace_speed_to_raw(float rad_per_s, float radius_cm);
+float accel_trace_raw_to_speed(float accel_raw, float radius_cm);
+
+#define HEADING_WINDOW_S		0.5
+
+//Heading the control loop would hold, against the real one
+//Each sample period the loop runs at the speed the estimator gives it, while the bot turns at its real speed
+struct heading_drift {
+	double error_rad;			//estimated - true heading, running
+	double rotation_start_error_rad;
+	double next_rotation_rad;	//true angle the current rotation ends at
+	double abs_drift_sum_rad;	//|heading error gained| summed over whole rotations
+	u_int32_t rotations;
+	double rpm_error_sum2;
+	u_int32_t rpm_samples;
+	double window_end_s;		//HEADING_WINDOW_S windows - slow wander (aliased ripple) shows up here
+	double window_start_error_rad;
+	double window_drift_sum2;
+	u_int32_t windows;
+};
+
+//counts from the first update - leave out samples before the estimate has settled
+void heading_drift_start(struct heading_drift *drift);
+
+//one sample period [sample->time_s, + period_s) run at estimated_rad_per_s
+void heading_drift_update(struct heading_drift *drift, const struct accel_trace_config *config,
+			  const struct accel_trace_sample *sample, float estimated_rad_per_s);
+
+//mean |heading error| gained per rotation, degrees
+float heading_drift_deg_per_rotation(const struct heading_drift *drift);
+
+float heading_drift_rpm_rms(const struct heading_drift *drift);
+
+//rms heading error gained per HEADING_WINDOW_S, degrees
+float heading_drift_window_rms_deg(const struct heading_drift *drift);
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * Control failsafe (src/melty_ble.c) - control writes through the characteristic's write
+ * handler, motors stubbed to record when they were armed / stopped by the failsafe timer
+ */
+
+#include <ztest.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#include "melty_ble.h"
+#include "melty.h"
+#include "accel.h"
+#include "accel_cal.h"
+#include "conn_params.h"
+
+#define TIMEOUT_US				(CONFIG_MELTY_CONTROL_TIMEOUT_MS * 1000)
+//k_timer expiry lands on a tick boundary - allow it to round up by a couple
+#define MAX_LATE_US				(2 * 1000000 / CONFIG_SYS_CLOCK_TICKS_PER_SEC)
+
+//controller app writes every 50 ms or so
+#define WRITE_INTERVAL_MS		50
+#define KEEP_ALIVE_WRITES		40
+
+extern const struct bt_gatt_service_static meltyble_svc;
+
+static const struct bt_gatt_attr *control_attr;
+static u_int32_t sequence;
+
+//motor stubs - failsafe_expired calls motors_disarm from the timer interrupt
+static volatile u_int32_t arms;
+static volatile u_int32_t disarms;
+static volatile u_int32_t disarm_cycles;
+
+void motors_safe(void)
+{
+}
+
+void motors_disarm(void)
+{
+	disarm_cycles = k_cycle_get_32();
+	disarms++;
+}
+
+void motors_arm(void)
+{
+	arms++;
+}
+
+//rest of the app is not linked
+void update_melty_parameters(void)
+{
+}
+
+void conn_params_set_throttle(u_int8_t throttle)
+{
+}
+
+void get_conn_link(struct conn_link *link)
+{
+	*link = (struct conn_link){ 0 };
+}
+
+void get_accel_stats(struct accel_stats *stats)
+{
+	*stats = (struct accel_stats){ 0 };
+}
+
+int accel_cal_start(void)
+{
+	return 0;
+}
+
+void accel_cal_clear(void)
+{
+}
+
+enum accel_cal_state accel_cal_get(struct accel_cal_offsets *offsets)
+{
+	*offsets = (struct accel_cal_offsets){ 0 };
+	return ACCEL_CAL_NONE;
+}
+
+//write without response as the client sends it - returns k_cycle_get_32() at the write
+static u_int32_t write_control(u_int32_t write_sequence)
+{
+	u_int8_t value[MELTY_CONFIG_LEN] = { 0 };
+
+	sys_put_le16(3000, &value[0]);		//radius cm * 1000
+	value[3] = 50;						//throttle
+	sys_put_le32(write_sequence, &value[6]);
+
+	u_int32_t cycles = k_cycle_get_32();
+	ssize_t ret = control_attr->write(NULL, control_attr, value, sizeof(value), 0, BT_GATT_WRITE_FLAG_CMD);
+
+	zassert_equal(ret, sizeof(value), "write handler returned %d", (int)ret);
+	return cycles;
+}
+
+static void check_trip(u_int32_t last_write_cycles)
+{
+	k_sleep(K_USEC(TIMEOUT_US + MAX_LATE_US * 2));
+
+	zassert_equal(disarms, 1, "failsafe tripped %u times", disarms);
+	zassert_false(get_control_valid(), NULL);
+
+	u_int32_t trip_us = k_cyc_to_us_floor32(disarm_cycles - last_write_cycles);
+
+	TC_PRINT("tripped %u us after the last accepted write\n", trip_us);
+	zassert_true(trip_us >= TIMEOUT_US - MAX_LATE_US / 2, "tripped early - %u us", trip_us);
+	zassert_true(trip_us <= TIMEOUT_US + MAX_LATE_US, "tripped late - %u us", trip_us);
+}
+
+static void *failsafe_setup(void)
+{
+	for (size_t x = 0; x < meltyble_svc.attr_count; x++) {
+		if (bt_uuid_cmp(meltyble_svc.attrs[x].uuid, BT_UUID_MELTYBLE_CONTROL) == 0) {
+			control_attr = &meltyble_svc.attrs[x];
+		}
+	}
+	zassert_not_null(control_attr, "no control characteristic value");
+
+	return NULL;
+}
+
+//as on disconnect - failsafe stopped, sequence forgotten
+static void failsafe_before(void *fixture)
+{
+	reset_control_sequence();
+	arms = 0;
+	disarms = 0;
+}
+
+ZTEST(failsafe, test_trips_after_timeout)
+{
+	u_int32_t write_cycles = write_control(++sequence);
+
+	zassert_true(get_control_valid(), NULL);
+	zassert_equal(arms, 1, NULL);
+
+	check_trip(write_cycles);
+}
+
+ZTEST(failsafe, test_writes_keep_alive)
+{
+	u_int32_t write_cycles = 0;
+
+	for (int x = 0; x < KEEP_ALIVE_WRITES; x++) {
+		write_cycles = write_control(++sequence);
+		k_sleep(K_MSEC(WRITE_INTERVAL_MS));
+
+		zassert_equal(disarms, 0, "tripped after write %d", x);
+		zassert_true(get_control_valid(), NULL);
+	}
+
+	zassert_equal(arms, KEEP_ALIVE_WRITES, NULL);
+
+	//timed from the last write, not the first
+	check_trip(write_cycles);
+}
+
+ZTEST(failsafe, test_stale_writes_ignored)
+{
+	u_int32_t write_cycles = write_control(++sequence);
+
+	//replayed / reordered writes must not hold the failsafe off
+	for (int x = 0; x < CONFIG_MELTY_CONTROL_TIMEOUT_MS / WRITE_INTERVAL_MS; x++) {
+		k_sleep(K_MSEC(WRITE_INTERVAL_MS / 2));
+		write_control(sequence);
+		write_control(sequence - 1);
+		write_control(0);
+	}
+
+	zassert_equal(arms, 1, "stale write armed the motors");
+	check_trip(write_cycles);
+}
+
+ZTEST(failsafe, test_disconnect_disarms)
+{
+	write_control(++sequence);
+	zassert_true(get_control_valid(), NULL);
+
+	reset_control_sequence();
+	zassert_equal(disarms, 1, NULL);
+	zassert_false(get_control_valid(), NULL);
+
+	//failsafe timer was stopped along with the motors - no second trip
+	k_sleep(K_USEC(TIMEOUT_US + MAX_LATE_US * 2));
+	zassert_equal(disarms, 1, NULL);
+}
+
+ZTEST_SUITE(failsafe, NULL, failsafe_setup, failsafe_before, NULL, NULL);
@@ -0,0 +1,153 @@
+/*
+ * Impact gate (src/impact_gate.c) on synthetic spin traces with a hit in them - recovery of the
+ * estimator fed every sample against the gated one (as accel.c feeds it)
+ */
+
+#include <ztest.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+
+#include "impact_gate.h"
+#include "rpm_estimator.h"
+#include "accel_pipeline.h"
+
+#define SETTLE_S				0.5
+#define IMPACT_S				1.0f
+
+//a hit can't be told apart before it's over - the gated estimate is back once the ringing is
+#define MAX_GATED_RECOVERY_MS	(IMPACT_SAMPLES * 1000.0f / 400 + 5.0f)
+
+static u_int32_t impacts;
+static u_int32_t rejected_samples;
+
+static float ungated_update(const struct accel_trace_config *config, const struct accel_trace_sample *sample,
+			    float *tangential_raw)
+{
+	rpm_estimator_update(sample->sample.x, sample->sample.timestamp_cycles);
+	return accel_pipeline_predict(config, sample);
+}
+
+static void gated_reset(void)
+{
+	rpm_estimator_reset();
+	impact_gate_reset();
+	impacts = 0;
+	rejected_samples = 0;
+}
+
+//as impact_gate() in accel.c
+static float gated_update(const struct accel_trace_config *config, const struct accel_trace_sample *sample,
+			  float *tangential_raw)
+{
+	u_int32_t timestamp_cycles = sample->sample.timestamp_cycles;
+
+	switch (impact_gate_check(sample->sample.x, timestamp_cycles, rpm_estimator_predict(timestamp_cycles))) {
+	case IMPACT_GATE_HIT:
+		impacts++;
+		//fall through
+	case IMPACT_GATE_REJECT:
+		rejected_samples++;
+		break;
+	case IMPACT_GATE_RESTART:
+		rpm_estimator_reset();
+		rpm_estimator_update(sample->sample.x, timestamp_cycles);
+		break;
+	case IMPACT_GATE_ACCEPT:
+		rpm_estimator_update(sample->sample.x, timestamp_cycles);
+		break;
+	}
+
+	return accel_pipeline_predict(config, sample);
+}
+
+static const struct accel_pipeline ungated = {
+	.name = "ungated",
+	.reset = rpm_estimator_reset,
+	.update = ungated_update,
+};
+
+static const struct accel_pipeline gated = {
+	.name = "gated",
+	.reset = gated_reset,
+	.update = gated_update,
+};
+
+//gated runs last - impacts / rejected_samples afterwards are its counts
+static struct accel_pipeline_results run_trace(const char *name, const struct accel_trace_config *config)
+{
+	struct accel_pipeline_results results = accel_pipeline_compare(name, config, SETTLE_S, &ungated, &gated);
+
+	TC_PRINT("%u impacts, %u samples rejected\n", impacts, rejected_samples);
+	return results;
+}
+
+//one hit, gone once it has rung down - no more than that rejected, heading held through it
+static void check_hit(const struct accel_pipeline_results *results)
+{
+	zassert_equal(impacts, 1, "%u impacts", impacts);
+	zassert_true(rejected_samples <= IMPACT_SAMPLES, "%u samples rejected", rejected_samples);
+	zassert_true(results->after.recovery_ms <= MAX_GATED_RECOVERY_MS, "recovered in %.1f ms",
+		     results->after.recovery_ms);
+	zassert_true(results->after.recovery_ms < results->before.recovery_ms / 2.0f,
+		     "recovered in %.1f ms (ungated %.1f)", results->after.recovery_ms, results->before.recovery_ms);
+	zassert_true(results->after.impact_heading_deg < results->before.impact_heading_deg / 4.0f,
+		     "heading %.1f deg off after the hit (ungated %.1f)", results->after.impact_heading_deg,
+		     results->before.impact_heading_deg);
+}
+
+//real speed changes must all get through - nothing rejected, nothing lost against feeding every sample
+static void check_no_hit(const struct accel_pipeline_results *results)
+{
+	zassert_equal(rejected_samples, 0, "%u samples rejected", rejected_samples);
+	zassert_true(results->after.rpm_rms <= results->before.rpm_rms, "rpm rms %.2f (ungated %.2f)",
+		     results->after.rpm_rms, results->before.rpm_rms);
+}
+
+//32 count noise (as the tilt traces), a +150 g hit ringing down over 4 samples
+#define HIT_TRACE(start, end, ramp, impact) \
+	ACCEL_TRACE(start, end, ramp, 2.0f, .noise_raw = 32.0f, .quantization_raw = 2, .impact_s = IMPACT_S, \
+		    .impact_g = (impact), .seed = 11)
+
+ZTEST(impact_gate, test_hit_1500_rpm)
+{
+	const struct accel_trace_config config = HIT_TRACE(1500.0f, 1500.0f, 0.0f, 150.0f);
+	struct accel_pipeline_results results = run_trace("1500 RPM, 150 g hit", &config);
+
+	check_hit(&results);
+}
+
+//small against the centripetal reading - still well outside noise plus the fastest real change
+ZTEST(impact_gate, test_hit_2400_rpm)
+{
+	const struct accel_trace_config config = HIT_TRACE(2400.0f, 2400.0f, 0.0f, 40.0f);
+	struct accel_pipeline_results results = run_trace("2400 RPM, 40 g hit", &config);
+
+	check_hit(&results);
+}
+
+ZTEST(impact_gate, test_hit_spin_up)
+{
+	const struct accel_trace_config config = HIT_TRACE(800.0f, 2400.0f, 2.0f, 150.0f);
+	struct accel_pipeline_results results = run_trace("800 -> 2400 RPM over 2 s, 150 g hit", &config);
+
+	check_hit(&results);
+}
+
+//about as hard as the drive spins up (0 -> 200 g in 0.25 s)
+ZTEST(impact_gate, test_no_hit_fast_spin_up)
+{
+	const struct accel_trace_config config = HIT_TRACE(600.0f, 2400.0f, 0.5f, 0.0f);
+	struct accel_pipeline_results results = run_trace("600 -> 2400 RPM over 0.5 s, no hit", &config);
+
+	check_no_hit(&results);
+}
+
+ZTEST(impact_gate, test_no_hit_steady)
+{
+	const struct accel_trace_config config = HIT_TRACE(1500.0f, 1500.0f, 0.0f, 0.0f);
+	struct accel_pipeline_results results = run_trace("1500 RPM, no hit", &config);
+
+	check_no_hit(&results);
+}
+
+ZTEST_SUITE(impact_gate, NULL, NULL, NULL, NULL, NULL);
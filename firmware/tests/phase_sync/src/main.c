@@ -0,0 +1,144 @@
+/*
+ * Phase synchronous averaging (src/phase_sync.c) on synthetic traces of an eccentric bot -
+ * estimator fed single samples against rotation averages (as accel.c feeds it)
+ */
+
+#include <ztest.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+
+#include "phase_sync.h"
+#include "rpm_estimator.h"
+#include "accel_pipeline.h"
+
+//first window needs a whole rotation, ripple is judged over 8 more and the estimator restarts on
+//the first average after that - skip it all (single samples skip the same stretch)
+#define SETTLE_S				1.0
+
+static void pipeline_reset(void)
+{
+	rpm_estimator_reset();
+	phase_sync_reset();
+}
+
+static float single_update(const struct accel_trace_config *config, const struct accel_trace_sample *sample,
+			   float *tangential_raw)
+{
+	rpm_estimator_update(sample->sample.x, sample->sample.timestamp_cycles);
+	return accel_pipeline_predict(config, sample);
+}
+
+//as update_rpm_estimate() in accel.c
+static float averaged_update(const struct accel_trace_config *config, const struct accel_trace_sample *sample,
+			     float *tangential_raw)
+{
+	int32_t estimator_raw;
+	u_int32_t estimator_cycles;
+	u_int32_t timestamp_cycles = sample->sample.timestamp_cycles;
+
+	float rad_per_s = accel_trace_raw_to_speed(rpm_estimator_predict(timestamp_cycles), config->radius_cm);
+	switch (phase_sync_select(sample->sample.x, timestamp_cycles, rad_per_s, &estimator_raw, &estimator_cycles)) {
+	case PHASE_SYNC_FEED_RESTART:
+		rpm_estimator_reset();
+		rpm_estimator_update(estimator_raw, estimator_cycles);
+		break;
+	case PHASE_SYNC_FEED_UPDATE:
+		rpm_estimator_update(estimator_raw, estimator_cycles);
+		break;
+	case PHASE_SYNC_FEED_NONE:
+		break;
+	}
+
+	return accel_pipeline_predict(config, sample);
+}
+
+static const struct accel_pipeline single = {
+	.name = "single samples",
+	.reset = pipeline_reset,
+	.update = single_update,
+};
+
+static const struct accel_pipeline averaged = {
+	.name = "phase sync",
+	.reset = pipeline_reset,
+	.update = averaged_update,
+};
+
+//averages run last - phase_sync_engaged() afterwards is whether they were fed at the end of the trace
+static struct accel_pipeline_results run_trace(const char *name, const struct accel_trace_config *config)
+{
+	return accel_pipeline_compare(name, config, SETTLE_S, &single, &averaged);
+}
+
+//ripple locked to the rotation - averages must be engaged and take out most of it, heading no worse
+static void check_ripple(const struct accel_pipeline_results *results)
+{
+	zassert_true(phase_sync_engaged(), "ripple not detected");
+	zassert_true(results->after.rpm_rms < results->before.rpm_rms / 4.0f, "rpm rms %.2f (single samples %.2f)",
+		     results->after.rpm_rms, results->before.rpm_rms);
+	zassert_true(results->after.window_drift_deg <= results->before.window_drift_deg,
+		     "drift %.2f deg (single samples %.2f)", results->after.window_drift_deg, results->before.window_drift_deg);
+}
+
+//nothing to average out - the half rotation old window would only cost latency, so single samples stay
+static void check_no_ripple(const struct accel_pipeline_results *results)
+{
+	zassert_false(phase_sync_engaged(), "engaged on noise alone");
+	zassert_true(results->after.window_drift_deg <= results->before.window_drift_deg,
+		     "drift %.2f deg (single samples %.2f)", results->after.window_drift_deg, results->before.window_drift_deg);
+}
+
+#define ECCENTRIC_TRACE(start, end, ramp, ripple1, ripple2) \
+	ACCEL_TRACE(start, end, ramp, 10.0f, .noise_raw = 64.0f, .quantization_raw = 2, .ripple_1x = (ripple1), \
+		    .ripple_2x = (ripple2), .seed = 5)
+
+//rotation rate a near multiple of the ODR - ripple aliases to a slow beat
+ZTEST(phase_sync, test_eccentric_1430_rpm)
+{
+	const struct accel_trace_config config = ECCENTRIC_TRACE(1430.0f, 1430.0f, 0.0f, 0.05f, 0.0f);
+	struct accel_pipeline_results results = run_trace("1430 RPM, 5% eccentric", &config);
+
+	check_ripple(&results);
+}
+
+ZTEST(phase_sync, test_eccentric_830_rpm)
+{
+	const struct accel_trace_config config = ECCENTRIC_TRACE(830.0f, 830.0f, 0.0f, 0.10f, 0.0f);
+	struct accel_pipeline_results results = run_trace("830 RPM, 10% eccentric", &config);
+
+	check_ripple(&results);
+}
+
+ZTEST(phase_sync, test_eccentric_second_harmonic)
+{
+	const struct accel_trace_config config = ECCENTRIC_TRACE(2390.0f, 2390.0f, 0.0f, 0.05f, 0.02f);
+	struct accel_pipeline_results results = run_trace("2390 RPM, 5% eccentric + 2% 2x", &config);
+
+	check_ripple(&results);
+}
+
+ZTEST(phase_sync, test_eccentric_spin_up)
+{
+	const struct accel_trace_config config = ECCENTRIC_TRACE(800.0f, 2400.0f, 2.0f, 0.05f, 0.0f);
+	struct accel_pipeline_results results = run_trace("800 -> 2400 RPM over 2 s, 5% eccentric", &config);
+
+	check_ripple(&results);
+}
+
+ZTEST(phase_sync, test_no_ripple)
+{
+	const struct accel_trace_config config = ECCENTRIC_TRACE(1430.0f, 1430.0f, 0.0f, 0.0f, 0.0f);
+	struct accel_pipeline_results results = run_trace("1430 RPM, no ripple", &config);
+
+	check_no_ripple(&results);
+}
+
+ZTEST(phase_sync, test_no_ripple_spin_up)
+{
+	const struct accel_trace_config config = ECCENTRIC_TRACE(800.0f, 2400.0f, 2.0f, 0.0f, 0.0f);
+	struct accel_pipeline_results results = run_trace("800 -> 2400 RPM over 2 s, no ripple", &config);
+
+	check_no_ripple(&results);
+}
+
+ZTEST_SUITE(phase_sync, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,108 @@
+/*
+ * Error bounds of the fixed point rotation interval (src/rotation_lut.c) against the float
+ * formula it replaced, over every raw count the accelerometer can report
+ */
+
+#include <ztest.h>
+#include <zephyr/types.h>
+#include <math.h>
+
+#include "rotation_lut.h"
+#include "accel.h"
+
+//interpolation error of the table, plus 1 us for rounding to whole us
+#define MAX_ERROR_FRACTION		0.00035
+#define MAX_ERROR_US			1.0
+
+//200 g in normalized counts - the range the interval was originally specified over
+#define RAW_200G				((int32_t)(200 * ACCEL_ONE_G_RAW))
+
+//radius in cm * 1000 (as sent by BLE client) - 0.1 cm up to the largest the client can send
+static const u_int16_t radii_raw[] = { 100, 1000, 3000, 7500, 20000, 65000 };
+
+//interval_ms = 60000 / sqrt(g * 89445 / radius_cm), capped at 250 ms (previous get_rotation_interval_ms)
+static double reference_interval_us(int32_t accel_raw, u_int16_t radius_raw)
+{
+	double g = accel_raw * ACCEL_MG_PER_RAW / 1000.0;
+	double rpm = sqrt(g * 89445.0 / (radius_raw / 1000.0));
+	double interval_us = 60.0 * 1000 * 1000 / rpm;
+
+	return interval_us > ROTATION_LUT_MAX_INTERVAL_US ? ROTATION_LUT_MAX_INTERVAL_US : interval_us;
+}
+
+//every raw count first..last within bounds for one radius
+static void check_error(u_int16_t radius_raw, int32_t first, int32_t last)
+{
+	double worst = 0.0;
+	int32_t worst_raw = first;
+
+	set_rotation_lut_radius(radius_raw);
+
+	for (int32_t raw = first; raw <= last; raw++) {
+		double reference = reference_interval_us(raw, radius_raw);
+		double error = fabs(get_rotation_interval_us(raw) - reference);
+		double allowed = reference * MAX_ERROR_FRACTION + MAX_ERROR_US;
+
+		zassert_true(error <= allowed, "radius %u raw %d: %u us, reference %.1f us", radius_raw, raw,
+			     get_rotation_interval_us(raw), reference);
+
+		if (error > MAX_ERROR_US && (error - MAX_ERROR_US) / reference > worst) {
+			worst = (error - MAX_ERROR_US) / reference;
+			worst_raw = raw;
+		}
+	}
+
+	TC_PRINT("radius %u: worst error %.4f%% at raw %d\n", radius_raw, worst * 100.0, worst_raw);
+}
+
+static void *rotation_lut_setup(void)
+{
+	init_rotation_lut();
+	return NULL;
+}
+
+ZTEST(rotation_lut, test_error_to_200g)
+{
+	for (int x = 0; x < ARRAY_SIZE(radii_raw); x++) {
+		check_error(radii_raw[x], 1, RAW_200G);
+	}
+}
+
+//octaves added for the 400 g range - last one runs up to ACCEL_RAW_MAX
+ZTEST(rotation_lut, test_error_to_400g)
+{
+	for (int x = 0; x < ARRAY_SIZE(radii_raw); x++) {
+		check_error(radii_raw[x], RAW_200G, ACCEL_RAW_MAX);
+	}
+}
+
+ZTEST(rotation_lut, test_no_accel)
+{
+	set_rotation_lut_radius(3000);
+
+	zassert_equal(get_rotation_interval_us(0), ROTATION_LUT_MAX_INTERVAL_US, NULL);
+	zassert_equal(get_rotation_interval_us(-500), ROTATION_LUT_MAX_INTERVAL_US, NULL);
+}
+
+ZTEST(rotation_lut, test_past_full_scale)
+{
+	set_rotation_lut_radius(3000);
+
+	zassert_equal(get_rotation_interval_us(ACCEL_RAW_MAX + 1), get_rotation_interval_us(ACCEL_RAW_MAX), NULL);
+	zassert_equal(get_rotation_interval_us(INT32_MAX), get_rotation_interval_us(ACCEL_RAW_MAX), NULL);
+}
+
+ZTEST(rotation_lut, test_radius_change)
+{
+	//interval goes with sqrt(radius) - 4x radius is twice the interval
+	set_rotation_lut_radius(2000);
+	u_int32_t interval = get_rotation_interval_us(20000);
+
+	set_rotation_lut_radius(8000);
+	zassert_within(get_rotation_interval_us(20000), interval * 2, 2, NULL);
+
+	set_rotation_lut_radius(2000);
+	zassert_equal(get_rotation_interval_us(20000), interval, NULL);
+}
+
+ZTEST_SUITE(rotation_lut, NULL, rotation_lut_setup, NULL, NULL, NULL);
@@ -0,0 +1,167 @@
+/*
+ * Heading drift of the rotation phase accumulator (src/rotation_phase.c) over simulated
+ * rotations, against the per rotation elapsed time reset it replaced
+ */
+
+#include <ztest.h>
+#include <zephyr/types.h>
+
+#include "rotation_phase.h"
+
+#define SIMULATED_ROTATIONS		10000
+
+//nRF52 k_cycle_get_32() runs off the 32768 Hz RTC
+#define RTC_CYCLES_PER_SEC		32768
+
+//heading after SIMULATED_ROTATIONS may be off by this much (rounding only, nothing accumulates)
+#define MAX_DRIFT_DEG			0.001
+
+struct drift {
+	double accumulator_deg;		//free running phase
+	double reset_deg;			//elapsed time reset every rotation (overshoot thrown away)
+};
+
+//polling loop pass length - k_sleep(K_USEC(10)) rounds up to a tick, BLE events stretch some passes
+static u_int32_t next_pass_cycles(u_int32_t *seed, u_int32_t min_cycles, u_int32_t spread_cycles)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return min_cycles + (*seed >> 16) % (spread_cycles + 1);
+}
+
+//heading error (rotations run vs. rotations that really went by) after SIMULATED_ROTATIONS
+static struct drift simulate(u_int32_t rotation_interval_us, u_int32_t cycles_per_sec,
+			     u_int32_t min_pass_cycles, u_int32_t spread_pass_cycles)
+{
+	struct rotation_phase_rate rate;
+	struct drift drift;
+	double cycles_per_rotation = (double)rotation_interval_us * cycles_per_sec / 1000000.0;
+	u_int32_t seed = 1;
+
+	set_phase_rate(&rate, rotation_interval_us, cycles_per_sec);
+
+	//cycle counter wraps part way through
+	u_int32_t now = UINT32_MAX - 1000000;
+	struct rotation_phase phase = { .last_cycles = now };
+	u_int64_t elapsed = 0;
+	u_int32_t rotations = 0;
+
+	while (rotations < SIMULATED_ROTATIONS) {
+		u_int32_t pass = next_pass_cycles(&seed, min_pass_cycles, spread_pass_cycles);
+		now += pass;
+		elapsed += pass;
+		rotations += advance_rotation_phase(&phase, &rate, now);
+	}
+
+	double turned = rotations + phase.phase / 4294967296.0;
+	drift.accumulator_deg = (turned - elapsed / cycles_per_rotation) * 360.0;
+
+	//same passes, but each rotation starts from 0 and ends on the first pass past its interval
+	seed = 1;
+	elapsed = 0;
+	for (rotations = 0; rotations < SIMULATED_ROTATIONS; rotations++) {
+		u_int64_t spent = 0;
+
+		while (spent * 1000000 < (u_int64_t)rotation_interval_us * cycles_per_sec) {
+			spent += next_pass_cycles(&seed, min_pass_cycles, spread_pass_cycles);
+		}
+		elapsed += spent;
+	}
+
+	drift.reset_deg = (rotations - elapsed / cycles_per_rotation) * 360.0;
+
+	TC_PRINT("%u us rotation @ %u Hz: drift over %u rotations %.6f deg (reset every rotation %.1f deg)\n",
+		 rotation_interval_us, cycles_per_sec, SIMULATED_ROTATIONS, drift.accumulator_deg, drift.reset_deg);
+
+	return drift;
+}
+
+static void check_drift(const struct drift *drift)
+{
+	zassert_true(drift->accumulator_deg < MAX_DRIFT_DEG && drift->accumulator_deg > -MAX_DRIFT_DEG,
+		     "phase drifted %f deg", drift->accumulator_deg);
+
+	//overshoot of every rotation used to be dropped - heading fell behind
+	zassert_true(drift->reset_deg < -360.0, "reference loop should drift, got %f deg", drift->reset_deg);
+}
+
+ZTEST(rotation_phase, test_drift_3000_rpm)
+{
+	//~1 tick passes with the odd one stretched by a connection event
+	struct drift drift = simulate(20000, RTC_CYCLES_PER_SEC, 1, 3);
+
+	check_drift(&drift);
+}
+
+ZTEST(rotation_phase, test_drift_600_rpm)
+{
+	struct drift drift = simulate(100000, RTC_CYCLES_PER_SEC, 1, 40);
+
+	check_drift(&drift);
+}
+
+ZTEST(rotation_phase, test_drift_fast_counter)
+{
+	//rotation not a whole number of cycles - the carried remainder is all that keeps this on track
+	struct drift drift = simulate(14999, 1000000, 10, 50);
+
+	check_drift(&drift);
+}
+
+ZTEST(rotation_phase, test_rate_change_keeps_phase)
+{
+	struct rotation_phase_rate rate;
+	struct rotation_phase phase = { 0 };
+
+	set_phase_rate(&rate, 20000, 1000000);
+	zassert_equal(advance_rotation_phase(&phase, &rate, 5000), 0, NULL);
+	zassert_equal(phase.phase, 1UL << 30, "quarter rotation expected, got 0x%08x", phase.phase);
+
+	//a new rate only changes how fast phase moves from here on
+	set_phase_rate(&rate, 10000, 1000000);
+	zassert_equal(advance_rotation_phase(&phase, &rate, 7500), 0, NULL);
+	zassert_equal(phase.phase, 1UL << 31, "half rotation expected, got 0x%08x", phase.phase);
+
+	zassert_equal(advance_rotation_phase(&phase, &rate, 12500), 1, NULL);
+	zassert_equal(phase.phase, 0, "back at rotation start expected, got 0x%08x", phase.phase);
+}
+
+ZTEST(rotation_phase, test_long_pass_counts_rotations)
+{
+	struct rotation_phase_rate rate;
+	struct rotation_phase phase = { 0 };
+
+	set_phase_rate(&rate, 20000, 1000000);
+
+	//a pass held off for 3.25 rotations (BLE, flash write) crosses three boundaries, not one
+	zassert_equal(advance_rotation_phase(&phase, &rate, 65000), 3, NULL);
+	zassert_equal(phase.phase, 1UL << 30, "quarter rotation expected, got 0x%08x", phase.phase);
+
+	zassert_equal(advance_rotation_phase(&phase, &rate, 80000), 1, NULL);
+	zassert_equal(phase.phase, 0, "back at rotation start expected, got 0x%08x", phase.phase);
+}
+
+ZTEST(rotation_phase, test_start_skips_idle_time)
+{
+	struct rotation_phase_rate rate;
+	struct rotation_phase phase = { 0 };
+
+	set_phase_rate(&rate, 20000, 1000000);
+	zassert_equal(advance_rotation_phase(&phase, &rate, 5000), 0, NULL);
+
+	//spin stopped and restarted well over a rotation later - starts from 0 at the restart
+	start_rotation_phase(&phase, 1000000);
+	zassert_equal(phase.phase, 0, NULL);
+
+	zassert_equal(advance_rotation_phase(&phase, &rate, 1005000), 0, "idle time counted towards the spin");
+	zassert_equal(phase.phase, 1UL << 30, "quarter rotation expected, got 0x%08x", phase.phase);
+}
+
+ZTEST(rotation_phase, test_us_to_phase)
+{
+	zassert_equal(us_to_phase(0, 20000), 0, NULL);
+	zassert_equal(us_to_phase(5000, 20000), 1UL << 30, NULL);
+	zassert_equal(us_to_phase(20000, 20000), UINT32_MAX, "edge at end of rotation must never be reached");
+	zassert_equal(us_to_phase(25000, 20000), UINT32_MAX, NULL);
+}
+
+ZTEST_SUITE(rotation_phase, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,103 @@
+/*
+ * Rotation speed estimator (src/rpm_estimator_*.c) against the 0.5 EMA it replaced, on
+ * synthetic spin traces - heading drift the control loop would see, and RPM error
+ */
+
+#include <ztest.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+
+#include "rpm_estimator.h"
+#include "accel_pipeline.h"
+
+//the EMA value is used as is, the estimator is asked for the middle of the coming sample period
+//(as update_accel_prediction() does) - both scored from the first sample
+#define SETTLE_S				0.0
+
+static float ema_raw;
+static bool ema_started;
+
+static void ema_reset(void)
+{
+	ema_started = false;
+}
+
+static float ema_update(const struct accel_trace_config *config, const struct accel_trace_sample *sample,
+			float *tangential_raw)
+{
+	ema_raw = ema_started ? 0.5f * ema_raw + 0.5f * sample->sample.x : sample->sample.x;
+	ema_started = true;
+
+	return accel_trace_raw_to_speed(ema_raw, config->radius_cm);
+}
+
+static float estimator_update(const struct accel_trace_config *config, const struct accel_trace_sample *sample,
+			      float *tangential_raw)
+{
+	rpm_estimator_update(sample->sample.x, sample->sample.timestamp_cycles);
+	return accel_pipeline_predict(config, sample);
+}
+
+static const struct accel_pipeline ema = {
+	.name = "EMA",
+	.reset = ema_reset,
+	.update = ema_update,
+};
+
+static const struct accel_pipeline estimator = {
+	.name = "estimator",
+	.reset = rpm_estimator_reset,
+	.update = estimator_update,
+};
+
+static struct accel_pipeline_results run_trace(const char *name, const struct accel_trace_config *config)
+{
+	return accel_pipeline_compare(name, config, SETTLE_S, &ema, &estimator);
+}
+
+ZTEST(rpm_estimator, test_spin_up)
+{
+	//spin up at 3 cm, 2 count noise
+	const struct accel_trace_config config = ACCEL_TRACE(600.0f, 3000.0f, 1.0f, 1.0f, .noise_raw = 2.0f, .seed = 1);
+	struct accel_pipeline_results results = run_trace("600 -> 3000 RPM over 1 s", &config);
+
+	//EMA lags half a sample behind and never extrapolates - the estimator must take out most of that
+	zassert_true(results.after.drift_deg < results.before.drift_deg / 4.0f, "drift %.3f deg/rotation (EMA %.3f)",
+		     results.after.drift_deg, results.before.drift_deg);
+}
+
+//coarse sensor - 32 count noise, 16 count steps (200 g range LSB is 2 counts, 400 g 4, plus margin)
+#define NOISY_TRACE(start, end, ramp) \
+	ACCEL_TRACE(start, end, ramp, 2.0f, .noise_raw = 32.0f, .quantization_raw = 16, .seed = 7)
+
+ZTEST(rpm_estimator, test_noisy_spin_up)
+{
+	const struct accel_trace_config config = NOISY_TRACE(600.0f, 2400.0f, 1.0f);
+	struct accel_pipeline_results results = run_trace("600 -> 2400 RPM over 1 s, noisy", &config);
+
+	zassert_true(results.after.drift_deg < results.before.drift_deg / 4.0f, "drift %.3f deg/rotation (EMA %.3f)",
+		     results.after.drift_deg, results.before.drift_deg);
+	zassert_true(results.after.rpm_rms < results.before.rpm_rms, "rpm rms %.2f (EMA %.2f)",
+		     results.after.rpm_rms, results.before.rpm_rms);
+}
+
+//holding speed the EMA has no lag to lose - the estimator may not be much noisier than it
+ZTEST(rpm_estimator, test_noisy_steady_2000_rpm)
+{
+	const struct accel_trace_config config = NOISY_TRACE(2000.0f, 2000.0f, 0.0f);
+	struct accel_pipeline_results results = run_trace("2000 RPM, noisy", &config);
+
+	zassert_true(results.after.rpm_rms < results.before.rpm_rms * 1.5f, "rpm rms %.2f (EMA %.2f)",
+		     results.after.rpm_rms, results.before.rpm_rms);
+}
+
+ZTEST(rpm_estimator, test_noisy_steady_600_rpm)
+{
+	const struct accel_trace_config config = NOISY_TRACE(600.0f, 600.0f, 0.0f);
+	struct accel_pipeline_results results = run_trace("600 RPM, noisy", &config);
+
+	zassert_true(results.after.rpm_rms < results.before.rpm_rms * 1.5f, "rpm rms %.2f (EMA %.2f)",
+		     results.after.rpm_rms, results.before.rpm_rms);
+}
+
+ZTEST_SUITE(rpm_estimator, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,99 @@
+/*
+ * Seqlock publication (src/sensor_publish.h) - a reader thread copying samples while a
+ * higher priority writer thread publishes in bursts must never see a torn sample
+ */
+
+#include <ztest.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+#include "sensor_publish.h"
+
+#define STACK_SIZE				1024
+#define WRITER_PRIORITY			K_PRIO_PREEMPT(1)
+#define READER_PRIORITY			K_PRIO_PREEMPT(2)
+
+//publishes per writer wake up - more than one lands inside some reader copies
+#define WRITER_BURST			3
+#define WRITER_PUBLISHES		30000
+
+static K_THREAD_STACK_DEFINE(writer_stack, STACK_SIZE);
+static K_THREAD_STACK_DEFINE(reader_stack, STACK_SIZE);
+static struct k_thread writer_thread;
+static struct k_thread reader_thread;
+
+static struct sensor_publication publication;
+static atomic_t writer_done;
+
+//reader results - checked from the test thread once both threads have exited
+static u_int32_t reads;
+static u_int32_t torn_reads;
+static u_int32_t stale_reads;
+static u_int32_t samples_seen;
+
+//every publish carries its own count in value, raw and (by construction) sequence
+static void writer(void *p1, void *p2, void *p3)
+{
+	for (int32_t count = 1; count <= WRITER_PUBLISHES; count++) {
+		sensor_publish(&publication, (float)count, count);
+		if (count % WRITER_BURST == 0) k_sleep(K_TICKS(1));
+	}
+
+	atomic_set(&writer_done, 1);
+}
+
+static void reader(void *p1, void *p2, void *p3)
+{
+	u_int32_t last_sequence = 0;
+	struct sensor_sample sample;
+
+	while (!atomic_get(&writer_done)) {
+		sensor_read(&publication, &sample);
+		reads++;
+
+		if (sample.raw != (int32_t)sample.sequence || sample.value != (float)sample.raw) torn_reads++;
+		if (sample.sequence < last_sequence) stale_reads++;
+		if (sample.sequence != last_sequence) samples_seen++;
+		last_sequence = sample.sequence;
+
+		//native_posix only lets time (and the writer) move on inside kernel calls
+		k_busy_wait(1);
+	}
+}
+
+ZTEST(sensor_publish, test_read_latest)
+{
+	struct sensor_publication single = { 0 };
+	struct sensor_sample sample;
+
+	sensor_read(&single, &sample);
+	zassert_equal(sample.sequence, 0, "nothing published yet");
+
+	sensor_publish(&single, 1.5f, 1500);
+	sensor_publish(&single, 2.5f, 2500);
+	sensor_read(&single, &sample);
+	zassert_equal(sample.sequence, 2, NULL);
+	zassert_equal(sample.raw, 2500, NULL);
+	zassert_equal(sample.value, 2.5f, NULL);
+}
+
+ZTEST(sensor_publish, test_two_thread_stress)
+{
+	k_thread_create(&reader_thread, reader_stack, K_THREAD_STACK_SIZEOF(reader_stack), reader,
+			NULL, NULL, NULL, READER_PRIORITY, 0, K_NO_WAIT);
+	k_thread_create(&writer_thread, writer_stack, K_THREAD_STACK_SIZEOF(writer_stack), writer,
+			NULL, NULL, NULL, WRITER_PRIORITY, 0, K_NO_WAIT);
+
+	zassert_ok(k_thread_join(&writer_thread, K_SECONDS(60)), "writer did not finish");
+	zassert_ok(k_thread_join(&reader_thread, K_SECONDS(1)), "reader did not finish");
+
+	TC_PRINT("%u reads, %u of %u samples seen\n", reads, samples_seen, WRITER_PUBLISHES);
+
+	zassert_equal(torn_reads, 0, "%u torn reads", torn_reads);
+	zassert_equal(stale_reads, 0, "%u reads went back in time", stale_reads);
+	zassert_true(samples_seen > WRITER_PUBLISHES / WRITER_BURST / 2, "reader starved - %u samples seen",
+		     samples_seen);
+}
+
+ZTEST_SUITE(sensor_publish, NULL, NULL, NULL, NULL, NULL);
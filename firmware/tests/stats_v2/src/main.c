@@ -0,0 +1,100 @@
+/*
+ * Stats v2 notification packing (src/stats_v2.c) - records have to go out at the default ATT MTU
+ * of 23, when the central refuses (or hasn't finished) the MTU exchange
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <zephyr/types.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "stats_v2.h"
+
+#define DEFAULT_MTU				23
+#define NOTIFY_OVERHEAD			3
+
+static int32_t get_le24_signed(const u_int8_t *src)
+{
+	u_int32_t value = sys_get_le24(src);
+
+	return value & 0x800000 ? (int32_t)(value | 0xff000000) : (int32_t)value;
+}
+
+ZTEST(stats_v2, test_default_mtu)
+{
+	u_int32_t per_packet = stats_v2_records_per_packet(DEFAULT_MTU);
+
+	zassert_equal(per_packet, 1, "%u records at MTU 23", per_packet);
+	zassert_true(STATS_V2_HEADER_SIZE + per_packet * STATS_V2_RECORD_SIZE <= DEFAULT_MTU - NOTIFY_OVERHEAD, NULL);
+}
+
+ZTEST(stats_v2, test_larger_mtu)
+{
+	zassert_equal(stats_v2_records_per_packet(65), 3, NULL);
+	zassert_equal(stats_v2_records_per_packet(247), 13, NULL);
+	zassert_true(STATS_V2_HEADER_SIZE + 13 * STATS_V2_RECORD_SIZE <= 247 - NOTIFY_OVERHEAD, NULL);
+}
+
+ZTEST(stats_v2, test_no_mtu)
+{
+	zassert_equal(stats_v2_records_per_packet(0), 0, NULL);
+	zassert_equal(stats_v2_records_per_packet(NOTIFY_OVERHEAD + STATS_V2_HEADER_SIZE), 0, NULL);
+}
+
+//one record at MTU 23, read back as a client parses it (layout in melty_ble.h)
+ZTEST(stats_v2, test_record_layout)
+{
+	const struct melty_telemetry_record record = {
+		.sequence = 0xbeef,
+		.rotation_interval_us = 25000,
+		.accel_raw = -123456,
+		.battery_mv = 8100,
+		.loaded_mv = 7650,
+		.unloaded_mv = 8230,
+		.loop_jitter_us = 17,
+		.spin_rate_rpm_s = -2500,
+	};
+	u_int8_t packet[DEFAULT_MTU - NOTIFY_OVERHEAD];
+
+	memset(packet, 0xa5, sizeof(packet));
+	stats_v2_put_header(packet, 1);
+	stats_v2_put_record(&record, &packet[STATS_V2_HEADER_SIZE]);
+
+	const u_int8_t *dst = &packet[STATS_V2_HEADER_SIZE];
+
+	zassert_equal(packet[0], STATS_V2_VERSION, NULL);
+	zassert_equal(packet[1], 1, NULL);
+	zassert_equal(sys_get_le16(&dst[0]), 0xbeef, NULL);
+	zassert_equal(sys_get_le24(&dst[2]), 25000, NULL);
+	zassert_equal(get_le24_signed(&dst[5]), -123456, NULL);
+	zassert_equal(sys_get_le16(&dst[8]), 8100, NULL);
+	zassert_equal(sys_get_le16(&dst[10]), 7650, NULL);
+	zassert_equal(sys_get_le16(&dst[12]), 8230, NULL);
+	zassert_equal(sys_get_le16(&dst[14]), 17, NULL);
+	zassert_equal((int16_t)sys_get_le16(&dst[16]), -2500, NULL);
+
+	//nothing written past the record
+	for (size_t x = STATS_V2_HEADER_SIZE + STATS_V2_RECORD_SIZE; x < sizeof(packet); x++) {
+		zassert_equal(packet[x], 0xa5, "byte %u overwritten", x);
+	}
+}
+
+//a stopped bot has a rotation interval far beyond 24 bits, accel stays well inside them at 400 g
+ZTEST(stats_v2, test_record_saturates)
+{
+	struct melty_telemetry_record record = {
+		.rotation_interval_us = 60000000,
+		.accel_raw = 9000000,
+	};
+	u_int8_t dst[STATS_V2_RECORD_SIZE];
+
+	stats_v2_put_record(&record, dst);
+	zassert_equal(sys_get_le24(&dst[2]), 0xffffff, NULL);
+	zassert_equal(get_le24_signed(&dst[5]), 0x7fffff, NULL);
+
+	record.accel_raw = -9000000;
+	stats_v2_put_record(&record, dst);
+	zassert_equal(get_le24_signed(&dst[5]), -0x800000, NULL);
+}
+
+ZTEST_SUITE(stats_v2, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,136 @@
+/*
+ * Gravity / tilt compensation (src/tilt_comp.c) on synthetic tilted spin traces - RPM error of
+ * the estimator fed corrected against uncorrected X, and the tangential (spin rate) estimate
+ */
+
+#include <ztest.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+
+#include "tilt_comp.h"
+#include "rpm_estimator.h"
+#include "accel.h"
+#include "accel_pipeline.h"
+
+//as sent by the BLE client - cm * 1000, the 3 cm ACCEL_TRACE() spins at
+#define RADIUS_RAW				3000
+
+//tangential smoothing used for the uncorrected comparison (same as tilt_comp.c)
+#define TANGENTIAL_FILTER		0.05f
+
+//skip the first rotations while the gravity estimate settles
+#define SETTLE_S				0.5
+
+//estimator gets single samples, as below the phase sync threshold (or with phase sync off)
+static float filtered_tangential_raw;
+
+static void uncorrected_reset(void)
+{
+	rpm_estimator_reset();
+	filtered_tangential_raw = 0.0f;
+}
+
+static float uncorrected_update(const struct accel_trace_config *config, const struct accel_trace_sample *sample,
+				float *tangential_raw)
+{
+	filtered_tangential_raw += TANGENTIAL_FILTER * (sample->sample.y - filtered_tangential_raw);
+	*tangential_raw = filtered_tangential_raw;
+
+	rpm_estimator_update(sample->sample.x, sample->sample.timestamp_cycles);
+	return accel_pipeline_predict(config, sample);
+}
+
+static void corrected_reset(void)
+{
+	rpm_estimator_reset();
+	tilt_comp_reset();
+}
+
+static float corrected_update(const struct accel_trace_config *config, const struct accel_trace_sample *sample,
+			      float *tangential_raw)
+{
+	struct accel_ring_sample ring_sample = sample->sample;
+
+	//as update_accel_prediction()
+	tilt_comp_apply(&ring_sample, rpm_estimator_predict(ring_sample.timestamp_cycles), RADIUS_RAW);
+	*tangential_raw = tilt_comp_get_tangential_raw();
+
+	rpm_estimator_update(ring_sample.x, ring_sample.timestamp_cycles);
+	return accel_pipeline_predict(config, sample);
+}
+
+static const struct accel_pipeline uncorrected = {
+	.name = "uncorrected",
+	.reset = uncorrected_reset,
+	.update = uncorrected_update,
+	.scores_tangential = true,
+};
+
+static const struct accel_pipeline corrected = {
+	.name = "corrected",
+	.reset = corrected_reset,
+	.update = corrected_update,
+	.scores_tangential = true,
+};
+
+static struct accel_pipeline_results run_trace(const char *name, const struct accel_trace_config *config)
+{
+	return accel_pipeline_compare(name, config, SETTLE_S, &uncorrected, &corrected);
+}
+
+#define TILT_TRACE(start, end, ramp, tilt) \
+	ACCEL_TRACE(start, end, ramp, 3.0f, .noise_raw = 32.0f, .quantization_raw = 2, .tilt_deg = (tilt), .seed = 3)
+
+//holding speed tilted - most of the ripple has to come out of both X and Y
+static void check_steady_tilt(const struct accel_pipeline_results *results)
+{
+	zassert_true(results->after.rpm_rms < results->before.rpm_rms / 2.0f, "rpm rms %.2f (uncorrected %.2f)",
+		     results->after.rpm_rms, results->before.rpm_rms);
+	zassert_true(results->after.tangential_rms < results->before.tangential_rms, "tangential rms %.1f (uncorrected %.1f)",
+		     results->after.tangential_rms, results->before.tangential_rms);
+}
+
+ZTEST(tilt_comp, test_tilt_15_deg)
+{
+	const struct accel_trace_config config = TILT_TRACE(1500.0f, 1500.0f, 0.0f, 15.0f);
+	struct accel_pipeline_results results = run_trace("15 deg tilt, 1500 RPM", &config);
+
+	check_steady_tilt(&results);
+}
+
+ZTEST(tilt_comp, test_tilt_30_deg)
+{
+	const struct accel_trace_config config = TILT_TRACE(800.0f, 800.0f, 0.0f, 30.0f);
+	struct accel_pipeline_results results = run_trace("30 deg tilt, 800 RPM", &config);
+
+	check_steady_tilt(&results);
+}
+
+//estimator follows the ripple here - residual must not be taken against its prediction directly
+ZTEST(tilt_comp, test_tilt_30_deg_slow)
+{
+	const struct accel_trace_config config = TILT_TRACE(600.0f, 600.0f, 0.0f, 30.0f);
+	struct accel_pipeline_results results = run_trace("30 deg tilt, 600 RPM", &config);
+
+	check_steady_tilt(&results);
+}
+
+ZTEST(tilt_comp, test_tilt_spin_up)
+{
+	const struct accel_trace_config config = TILT_TRACE(800.0f, 2400.0f, 2.0f, 15.0f);
+	struct accel_pipeline_results results = run_trace("15 deg tilt, 800 -> 2400 RPM over 2 s", &config);
+
+	zassert_true(results.after.rpm_rms < results.before.rpm_rms, NULL);
+}
+
+//nothing to remove - correction must not make things worse
+ZTEST(tilt_comp, test_level)
+{
+	const struct accel_trace_config config = TILT_TRACE(1500.0f, 1500.0f, 0.0f, 0.0f);
+	struct accel_pipeline_results results = run_trace("level, 1500 RPM", &config);
+
+	zassert_true(results.after.rpm_rms < results.before.rpm_rms * 1.1f, NULL);
+	zassert_true(results.after.tangential_rms < results.before.tangential_rms * 1.1f, NULL);
+}
+
+ZTEST_SUITE(tilt_comp, NULL, NULL, NULL, NULL, NULL);
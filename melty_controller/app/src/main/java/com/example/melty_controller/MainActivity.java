@@ -35,11 +35,6 @@ public class MainActivity extends AppCompatActivity implements SensorEventListen
 
     static int headingLedOffset = 0;
 
-    static final int HEART_BEAT_FIRST_VAL = 10;
-    static final int HEART_BEAT_LAST_VAL = 13;
-    static final int HEART_BEAT_UPDATE_FREQ_MS = 400;
-    static int currentHeartBeat = HEART_BEAT_FIRST_VAL;
-
     //to determine forward/back/idle translation
 
     SensorManager sensorManager;
@@ -130,25 +125,16 @@ public class MainActivity extends AppCompatActivity implements SensorEventListen
         if (translateDirection == TRANSLATE_REVERSE) translateTextView.setText("REVERSE");
         if (translateDirection == TRANSLATE_IDLE) translateTextView.setText("IDLE");
 
-        meltyBleClient.updateMeltyConfig(adjustedRadius, translateDirection, throttle, headingLedOffset, getCurrentHeartBeat());
+        meltyBleClient.updateMeltyConfig(adjustedRadius, translateDirection, throttle, headingLedOffset, isHeartBeatActive());
 
     }
 
-    long lastHeartBeatUpdate = 0;
-    private int getCurrentHeartBeat() {
+    private boolean isHeartBeatActive() {
 
-        //don't increment heartbeat if activity is paused - or heartbeat unchecked
+        //stop advancing the control sequence if activity is paused - or heartbeat unchecked
+        //(bot ignores repeated sequence numbers and stops the motors)
         CheckBox heartBeatCheckBox = (CheckBox) findViewById(R.id.heartBeatCheckBox);
-        if (!heartBeatCheckBox.isChecked() || !activityVisible) {
-            return currentHeartBeat;
-        }
-
-        if (uptimeMillis() - lastHeartBeatUpdate > HEART_BEAT_UPDATE_FREQ_MS) {
-            currentHeartBeat++;
-            if (currentHeartBeat > HEART_BEAT_LAST_VAL) currentHeartBeat = HEART_BEAT_FIRST_VAL;
-            lastHeartBeatUpdate = uptimeMillis();
-        }
-        return currentHeartBeat;
+        return heartBeatCheckBox.isChecked() && activityVisible;
     }
 
 
@@ -34,6 +34,7 @@ public class MeltyBleClient {
     private static final UUID CHARACTERISTIC_UPDATE_NOTIFICATION_DESCRIPTOR_UUID = UUID.fromString("00002902-0000-1000-8000-00805f9b34fb");
     private static final UUID MELTY_DATA_CHARACTERISTIC_UUID = UUID.fromString("00001524-1212-efde-1523-785feabcd123");
     private static final UUID MELTY_CONFIG_CHARACTERISTIC_UUID = UUID.fromString("00001525-1212-efde-1523-785feabcd123");
+    private static final UUID MELTY_CONTROL_CHARACTERISTIC_UUID = UUID.fromString("00001529-1212-efde-1523-785feabcd123");
 
     //Used to perform gatt connect / disconnect operations on main thread
     //https://github.com/android/connectivity-samples/issues/18
@@ -48,12 +49,26 @@ public class MeltyBleClient {
 
     BluetoothGattCharacteristic meltyDataCharacteristic;
     BluetoothGattCharacteristic meltyConfigCharacteristic;
+    //same payload written without response - null on older firmware (falls back to the acknowledged config write,
+    //in the 7 byte heartbeat layout if the bot predates sequence numbers)
+    BluetoothGattCharacteristic meltyControlCharacteristic;
 
     MeltyBleClientCallback meltyBleClientCallback;
 
     Boolean connectedAndInitialized = false;
     Boolean scanning = false;
     Boolean meltyConfigWritePending = false;
+    //newest payload that came in while a write was in flight - sent as soon as it completes (latest wins)
+    byte[] pendingMeltyConfig = null;
+    boolean pendingHeartBeat = false;
+
+    //must increase with every config write the bot should act on - restarted per connection
+    int controlSequence = 0;
+    //firmware from before sequence numbers takes 7 bytes with a heartbeat byte - found out when it refuses the length
+    boolean legacyConfigLayout = false;
+    //last payload written (10 byte layout) - resent in the legacy layout when refused
+    byte[] lastMeltyConfig = null;
+    boolean lastHeartBeat = false;
 
     Context context;
 
@@ -123,6 +138,8 @@ public class MeltyBleClient {
                 bluetoothGatt = null;
                 connectedAndInitialized = false;
                 meltyConfigWritePending = false;
+                pendingMeltyConfig = null;
+                controlSequence = 0;
                 meltyBleClientCallback.connectStatusUpdate("Disconnected (Code " + status + ")");
             }
         }
@@ -143,7 +160,24 @@ public class MeltyBleClient {
 
         @Override
         public void onCharacteristicWrite(BluetoothGatt gatt, BluetoothGattCharacteristic characteristic, int status) {
-            meltyConfigWritePending = false;
+            //back on the main thread with updateMeltyConfig - pending state is only touched there
+            handler.post(() -> {
+                meltyConfigWritePending = false;
+                if (characteristic == meltyConfigCharacteristic && status == BluetoothGatt.GATT_INVALID_ATTRIBUTE_LENGTH
+                        && !legacyConfigLayout) {
+                    Log.w("BLE", "Config write refused - older firmware, using 7 byte heartbeat layout");
+                    legacyConfigLayout = true;
+                    if (pendingMeltyConfig == null) {
+                        pendingMeltyConfig = lastMeltyConfig;
+                        pendingHeartBeat = lastHeartBeat;
+                    }
+                }
+                if (pendingMeltyConfig != null && connectedAndInitialized) {
+                    byte[] meltyConfigBytes = pendingMeltyConfig;
+                    pendingMeltyConfig = null;
+                    writeMeltyConfig(meltyConfigBytes, pendingHeartBeat);
+                }
+            });
             super.onCharacteristicWrite(gatt, characteristic, status);
         }
 
@@ -157,7 +191,9 @@ public class MeltyBleClient {
             if (status == BluetoothGatt.GATT_SUCCESS) {
 
                 meltyConfigCharacteristic = null;
+                meltyControlCharacteristic = null;
                 meltyDataCharacteristic = null;
+                legacyConfigLayout = false;
 
                 // Loops through available GATT Services.
                 for (BluetoothGattService gattService : gatt.getServices()) {
@@ -175,6 +211,10 @@ public class MeltyBleClient {
                         if (gattCharacteristic.getUuid().equals(MELTY_CONFIG_CHARACTERISTIC_UUID)) {
                             meltyConfigCharacteristic = gattCharacteristic;
                         }
+                        if (gattCharacteristic.getUuid().equals(MELTY_CONTROL_CHARACTERISTIC_UUID)) {
+                            meltyControlCharacteristic = gattCharacteristic;
+                            meltyControlCharacteristic.setWriteType(BluetoothGattCharacteristic.WRITE_TYPE_NO_RESPONSE);
+                        }
                     }
                 }
                 if (meltyConfigCharacteristic != null && meltyDataCharacteristic != null) {
@@ -255,28 +295,65 @@ public class MeltyBleClient {
                 }
             };
 
-    public void updateMeltyConfig(float radius, byte translateDirection, int throttle, int headingLedOffset, int currentHeartBeat) {
+    //heartBeat false resends the last sequence number - bot ignores it and failsafe stops the motors
+    public void updateMeltyConfig(float radius, byte translateDirection, int throttle, int headingLedOffset, boolean heartBeat) {
         if (!checkBlePermission()) return;
 
         radius = radius * 1000;     //value is passed as fixed point (x1000)
 
-        byte[] meltyConfigBytes = {0, 0, 0, 0, 0, 0, 0};
+        byte[] meltyConfigBytes = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
         meltyConfigBytes[0] = (byte)(Math.round(radius) % 256);
         meltyConfigBytes[1] = (byte)(Math.round(radius) / 256);
         meltyConfigBytes[2] = (byte)headingLedOffset;  //led offset
         meltyConfigBytes[3] = (byte)throttle;   //throttle
         meltyConfigBytes[4] = translateDirection;     //translate direction
-        meltyConfigBytes[5] = (byte)currentHeartBeat;
+        //byte 5 reserved
 
-        //this is always called from main thread - no need to use handler for gatt
-        if (connectedAndInitialized == true && !meltyConfigWritePending) {
-            meltyConfigCharacteristic.setValue(meltyConfigBytes);
-            if (bluetoothGatt.writeCharacteristic(meltyConfigCharacteristic)) {
-                meltyConfigWritePending = true;
-            } else {
-                Log.e("BLE", "write fail!");
-            }
+        if (connectedAndInitialized != true) return;
+
+        //Android runs one GATT operation at a time - even a write without response has to complete (queued in the
+        //stack, not acked by the bot) before the next. Keep only the newest payload and send it from onCharacteristicWrite
+        if (meltyConfigWritePending) {
+            pendingMeltyConfig = meltyConfigBytes;
+            pendingHeartBeat = heartBeat;
+            return;
+        }
+
+        writeMeltyConfig(meltyConfigBytes, heartBeat);
+    }
+
+    //main thread only - sequence number is taken when the write actually goes out, so payloads replaced while
+    //pending don't show up on the bot as lost writes
+    private void writeMeltyConfig(byte[] meltyConfigBytes, boolean heartBeat) {
+        if (!checkBlePermission()) return;
+
+        BluetoothGattCharacteristic characteristic = meltyControlCharacteristic != null ? meltyControlCharacteristic : meltyConfigCharacteristic;
+
+        if (heartBeat) controlSequence++;
+
+        //sequence number - little endian
+        meltyConfigBytes[6] = (byte)controlSequence;
+        meltyConfigBytes[7] = (byte)(controlSequence >> 8);
+        meltyConfigBytes[8] = (byte)(controlSequence >> 16);
+        meltyConfigBytes[9] = (byte)(controlSequence >> 24);
+
+        lastMeltyConfig = meltyConfigBytes;
+        lastHeartBeat = heartBeat;
+
+        if (legacyConfigLayout) {
+            //[5] heartbeat - the bot stops the motors when it stops changing, [6] reserved
+            byte[] legacyConfigBytes = {0, 0, 0, 0, 0, 0, 0};
+            System.arraycopy(meltyConfigBytes, 0, legacyConfigBytes, 0, 5);
+            legacyConfigBytes[5] = (byte)controlSequence;
+            characteristic.setValue(legacyConfigBytes);
+        } else {
+            characteristic.setValue(meltyConfigBytes);
+        }
+        if (bluetoothGatt.writeCharacteristic(characteristic)) {
+            meltyConfigWritePending = true;
+        } else {
+            Log.e("BLE", "write fail!");
         }
     }
 }